@@ -0,0 +1,26 @@
+#include <atomic>
+#include "backend.hpp"
+
+namespace  galaxy {
+    static std::atomic<const Backend*> current(NULL);
+
+    bool set_backend(backendType type) {
+        const Backend* b = type == NnpackBackend ? nnpack_backend() : native_backend();
+        if (!b) return false;
+        current.store(b);
+        return true;
+    }
+
+    const Backend& backend() {
+        const Backend* b = current.load();
+        if (!b) {
+            b = nnpack_backend() ? nnpack_backend() : native_backend();
+            current.store(b);
+        }
+        return *b;
+    }
+
+    backendType backend_type() {
+        return &backend() == nnpack_backend() ? NnpackBackend : NativeBackend;
+    }
+} //namespace  galaxy
@@ -0,0 +1,63 @@
+#ifndef BACKEND_HPP_
+#define BACKEND_HPP_
+
+#include <nnpack.h>
+#include "blob.hpp"
+#include "threadpool.hpp"
+
+namespace  galaxy {
+    struct Workspace;
+
+    // Dense kernels under the ops in math_functions. Shapes, output
+    // allocation, bias of FC layers and the sparse paths stay in the ops;
+    // a backend only computes on raw NCHW buffers. All methods must be
+    // safe to call from several threads at once.
+    class Backend {
+    public:
+        virtual ~Backend() {}
+        virtual const char* name() const = 0;
+
+        // Kernel in whatever form convolution() takes as transformed_w, to
+        // be computed once at model load; NULL when the backend has none.
+        virtual Blob* transform_kernel(const Blob* w) const { return NULL; }
+
+        // output (batch, w0, oh, ow) = w * input (batch, w1, ih, iw) + b,
+        // pad0 rows/cols before and pad1 after, optional ReLU. workspace
+        // may be NULL; profile, when given, is filled in.
+        virtual void convolution(const Blob* input, Blob* output, const Blob* w,
+                                 const Blob* b, int pad0, int pad1, int stride,
+                                 bool relu, Workspace* workspace,
+                                 const Blob* transformed_w, threadpool_t threadpool,
+                                 nnp_profile* profile) const = 0;
+        // pooling windows clipped to the image; padding only places them
+        virtual void max_pooling(const float* input, float* output, int batch,
+                                 int channels, int height, int width,
+                                 int out_height, int out_width, int size, int stride,
+                                 int pad_top, int pad_left, int pad_bottom, int pad_right,
+                                 threadpool_t threadpool) const = 0;
+        // output (batch, filters) = input (batch, input_dim) * w^T, no bias
+        virtual void fully_connected(const float* input, int batch, int input_dim,
+                                     int filters, const float* w, float* output,
+                                     threadpool_t threadpool, nnp_profile* profile) const = 0;
+        // in place, over each of the batch rows of n values
+        virtual void softmax(float* data, int batch, int n,
+                             threadpool_t threadpool) const = 0;
+        virtual void relu(float* data, int batch, int n, float negative_slope,
+                          threadpool_t threadpool) const = 0;
+    };
+
+    enum backendType {NnpackBackend, NativeBackend};
+
+    // The implementations; nnpack_backend() is NULL unless the build
+    // defines GALAXY_WITH_NNPACK.
+    const Backend* nnpack_backend();
+    const Backend* native_backend();
+
+    // NNPACK when it is built in, native otherwise. set_backend returns
+    // false and keeps the current backend when type is not built in. Set it
+    // before loading a Model so the kernel transforms are made for it.
+    bool set_backend(backendType type);
+    backendType backend_type();
+    const Backend& backend();
+} //namespace  galaxy
+#endif //BACKEND_HPP_
@@ -16,17 +16,25 @@ namespace  galaxy {
         return array_.get();
     }
 
-    float* bbox::array() {
+    float* bbox::array() const {
         return array_.get();
     }
 
     bbox::bbox(const std::shared_ptr<float> &array_) : array_(array_) {}
 
 
+    // 64-byte alignment lets NNPACK use any blob as a transform buffer
+    static float* allocate(int bytes) {
+        void* p = NULL;
+        if (posix_memalign(&p, 64, bytes > 0 ? bytes : 64) != 0) return NULL;
+        return static_cast<float*>(p);
+    }
+
     Blob::Blob(const int axis1){
 		count_ = axis1;
         capacity_ = count_ * sizeof(float);
-        data_ = (float*)malloc(capacity_);
+        data_ = allocate(capacity_);
+        owned_ = true;
         shape_ = { axis1 };
 	}
 
@@ -34,7 +42,8 @@ namespace  galaxy {
 		assert(axis2 < INT_MAX / axis1);
 		count_ = axis1*axis2;
         capacity_ = count_ * sizeof(float);
-        data_ = (float*)malloc(capacity_);
+        data_ = allocate(capacity_);
+        owned_ = true;
         shape_ = { axis1,axis2 };
 	}
 
@@ -43,7 +52,8 @@ namespace  galaxy {
 		assert(axis3 < INT_MAX / axis2 / axis1);
 		count_ = axis1*axis2*axis3;
         capacity_ = count_ * sizeof(float);
-        data_ = (float*)malloc(capacity_);
+        data_ = allocate(capacity_);
+        owned_ = true;
         shape_ = { axis1,axis2,axis3 };
 	}
 
@@ -54,7 +64,8 @@ namespace  galaxy {
 		assert(axis4 < INT_MAX / axis3 / axis2 / axis1);
 		count_ = axis1*axis2*axis3*axis4;
         capacity_ = count_ * sizeof(float);
-        data_ = (float*)malloc(capacity_);
+        data_ = allocate(capacity_);
+        owned_ = true;
         shape_ = { axis1,axis2,axis3,axis4 };
 	}
 
@@ -65,10 +76,20 @@ namespace  galaxy {
             count_ *= shape[i];
 		}
         capacity_ = count_ * sizeof(float);
-        data_ = (float*)malloc(capacity_);
+        data_ = allocate(capacity_);
+        owned_ = true;
         shape_.assign(shape.begin(), shape.end());
 	}
 
+    Blob::Blob(const Shape& shape, float* data)
+        :data_(data), owned_(false), shape_(shape){
+        count_ = 1;
+        for (size_t i = 0; i < shape.size(); ++i) {
+            count_ *= shape[i];
+        }
+        capacity_ = count_ * sizeof(float);
+    }
+
     void Blob::reshape(const Shape& shape) {
         count_ = 1;
         for (size_t i = 0; i < shape.size(); ++i) {
@@ -77,9 +98,10 @@ namespace  galaxy {
         int capacity = count_*sizeof(float);
 
         if (capacity != capacity_) {
+            assert(owned_);
             capacity_ = capacity;
             free(data_);
-            data_ = (float*)malloc(capacity_);
+            data_ = allocate(capacity_);
         }
         shape_.assign(shape.begin(), shape.end());
     }
@@ -97,7 +119,7 @@ namespace  galaxy {
 	}
 
 	Blob::~Blob() { 
-        free(data_);
+        if (owned_) free(data_);
     }
 
     float* Blob::data() const {
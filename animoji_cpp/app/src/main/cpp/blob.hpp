@@ -7,13 +7,16 @@ namespace  galaxy {
 	typedef std::vector<int> Shape;
 	class Blob {
     public:
-        Blob(): count_(0), capacity_(0), data_(NULL), shape_(0){}
+        Blob(): count_(0), capacity_(0), data_(NULL), owned_(true), shape_(0){}
 		explicit Blob(const int axis1, const int axis2, const int axis3,
 			const int axis4);
 		explicit Blob(const int axis1, const int axis2,	const int axis3);
 		explicit Blob(const int axis1, const int axis2);
 		explicit Blob(const int axis1);
 		explicit Blob(const Shape& shape);
+        // View of memory owned elsewhere, e.g. a mapped model snapshot;
+        // it is never freed or reshaped by the blob.
+        Blob(const Shape& shape, float* data);
         void reshape(const Shape& shape);
 		~Blob();
 
@@ -31,6 +34,7 @@ namespace  galaxy {
 		int count_;
 		int capacity_;
         float* data_;
+        bool owned_;
 		Shape shape_; 
 	};
 	
@@ -42,7 +46,7 @@ namespace  galaxy {
 		bbox(const std::shared_ptr<float> &array_);
 
 		float* create_array(int n=10);
-        float* array();
+        float* array() const;
 		int x1, y1, x2, y2;
         float score;
     protected:
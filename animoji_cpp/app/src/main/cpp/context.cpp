@@ -0,0 +1,331 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include "context.hpp"
+
+namespace  galaxy {
+    DetectPlan::DetectPlan(int width, int height, int batch)
+        :width(width), height(height), batch(batch), input(new Blob(batch, 3, height, width)),
+         blobs(18){
+        memset(input->data(), 0, input->capacity());
+    }
+
+    DetectPlan::~DetectPlan(){
+        delete input;
+        for (size_t i = 0; i < blobs.size(); ++i) {
+            delete blobs[i];
+        }
+    }
+
+    InferenceContext::InferenceContext(int num_threads, const PoolOptions& pool)
+        :InferenceContext(num_threads, pool, std::shared_ptr<SharedThreadPool>()){
+    }
+
+    InferenceContext::InferenceContext(std::shared_ptr<SharedThreadPool> pool)
+        :InferenceContext(pool->threads(), PoolOptions(), pool){
+    }
+
+    InferenceContext::InferenceContext(int num_threads, const PoolOptions& pool,
+                                       std::shared_ptr<SharedThreadPool> shared)
+        :pool_options_(pool), shared_pool_(shared),
+         landmark_threads_(0), profiling_(false), capture_(false), tracer_(NULL),
+         threadpool_(NULL), landmark_pool_(NULL), thread_policy_(UniformThreads),
+         inline_small_(true), landmark_blobs_(13), landmark_cascade_(false),
+         outputs_(OutputAll), max_faces_(0), face_rank_(RankByScore),
+         deadline_ms_(0), level_(-1), previous_level_(-1), frames_at_level_(0),
+         speculative_(false), speculative_iou_(0.7f), speculative_ctx_(NULL),
+         speculative_worker_(NULL){
+        int nMaxThreads = std::thread::hardware_concurrency();
+        int nThreads;
+        if((num_threads <=0 || num_threads > nMaxThreads)){
+            nThreads = nMaxThreads;
+        }
+        else{
+            nThreads = num_threads;
+        }
+        num_threads_ = nThreads;
+        create_pools();
+        set_input_size(112, 112);
+        set_tracking(0);
+    }
+
+    void InferenceContext::create_pools(){
+        int landmark_threads = landmark_threads_;
+        // a shared pool leaves no threads to speculate on
+        if (shared_pool_) {
+            threadpool_ = shared_pool_->pool();
+            landmark_pool_ = landmark_threads == 1 ? NULL : threadpool_;
+            if (!cpus_.empty()) pin_threadpool(threadpool_, cpus_);
+            return;
+        }
+        if (speculative_) {
+            // both stages run at once, so they split the threads between
+            // them; speculation gets a context of its own, so it never
+            // touches this one's pools, schedules or stats
+            if (landmark_threads <= 0) landmark_threads = (std::max)(1, num_threads_/2);
+            threadpool_ = create_threadpool((std::max)(1, num_threads_ - landmark_threads), pool_options_);
+            landmark_pool_ = threadpool_;
+            if (!cpus_.empty()) pin_threadpool(threadpool_, cpus_);
+            speculative_ctx_ = new InferenceContext(landmark_threads, pool_options_);
+            if (!cpus_.empty()) speculative_ctx_->set_cpu_affinity(cpus_);
+            speculative_worker_ = new Worker();
+            return;
+        }
+        if (landmark_threads <= 0) {
+            threadpool_ = create_threadpool(num_threads_, pool_options_);
+            landmark_pool_ = threadpool_;
+            if (!cpus_.empty()) pin_threadpool(threadpool_, cpus_);
+            return;
+        }
+        threadpool_ = create_threadpool(num_threads_, pool_options_);
+        if (!cpus_.empty()) pin_threadpool(threadpool_, cpus_);
+        landmark_pool_ = landmark_threads > 1 ? create_threadpool(landmark_threads, pool_options_) : NULL;
+        if (!cpus_.empty()) pin_threadpool(landmark_pool_, cpus_);
+    }
+
+    // Schedules and plans hold pool pointers, so they go with the pools.
+    void InferenceContext::destroy_pools(){
+        delete speculative_worker_;
+        delete speculative_ctx_;
+        speculative_worker_ = NULL;
+        speculative_ctx_ = NULL;
+        clear_plans();
+        landmark_schedules_.clear();
+        for (std::map<int, threadpool_t>::iterator it = sized_pools_.begin();
+             it != sized_pools_.end(); ++it) {
+            threadpool_destroy(it->second);
+        }
+        sized_pools_.clear();
+        if (landmark_pool_ && landmark_pool_ != threadpool_)
+            threadpool_destroy(landmark_pool_);
+        if (threadpool_ && !shared_pool_)
+            threadpool_destroy(threadpool_);
+        threadpool_ = landmark_pool_ = NULL;
+    }
+
+    void InferenceContext::set_speculative(bool enable, float iou_thresh){
+        speculative_iou_ = iou_thresh;
+        prev_detections_.clear();
+        if (enable == speculative_) return;
+        speculative_ = enable;
+        destroy_pools();
+        create_pools();
+    }
+
+    void InferenceContext::set_landmark_threads(int num_threads){
+        if (num_threads == landmark_threads_) return;
+        landmark_threads_ = num_threads;
+        destroy_pools();
+        create_pools();
+    }
+
+    void InferenceContext::set_thread_policy(threadPolicy policy, bool inline_small_ops){
+        thread_policy_ = policy;
+        inline_small_ = inline_small_ops;
+        clear_plans();
+        landmark_schedules_.clear();
+    }
+
+    void InferenceContext::set_cpu_affinity(const std::vector<int>& cpus){
+        cpus_ = cpus;
+        if (cpus_.empty()) return;
+        pin_threadpool(threadpool_, cpus_);
+        if (landmark_pool_ != threadpool_) pin_threadpool(landmark_pool_, cpus_);
+        if (speculative_ctx_) speculative_ctx_->set_cpu_affinity(cpus_);
+        for (std::map<int, threadpool_t>::iterator it = sized_pools_.begin();
+             it != sized_pools_.end(); ++it) {
+            pin_threadpool(it->second, cpus_);
+        }
+    }
+
+    threadpool_t InferenceContext::pool_for(int threads){
+        if (threads <= 1) return NULL;
+        // a shared pool is the whole budget; no private pools beside it
+        if (threads >= detect_threads() || shared_pool_) return threadpool_;
+        std::map<int, threadpool_t>::iterator it = sized_pools_.find(threads);
+        if (it != sized_pools_.end()) return it->second;
+        threadpool_t pool = create_threadpool(threads, pool_options_);
+        if (!cpus_.empty()) pin_threadpool(pool, cpus_);
+        sized_pools_[threads] = pool;
+        return pool;
+    }
+
+    std::vector<threadpool_t> InferenceContext::resolve(const std::vector<int>& threads){
+        std::vector<threadpool_t> pools(threads.size());
+        for (size_t i = 0; i < threads.size(); ++i) {
+            pools[i] = pool_for(threads[i]);
+        }
+        return pools;
+    }
+
+    InferenceContext* InferenceContext::speculative_context(){
+        InferenceContext* s = speculative_ctx_;
+        if (!s) return NULL;
+        if (s->thread_policy_ != thread_policy_ || s->inline_small_ != inline_small_)
+            s->set_thread_policy(thread_policy_, inline_small_);
+        // it never tracks, so it runs the heads tracking needs as outputs
+        if (s->outputs_ != landmark_outputs()) s->set_outputs(landmark_outputs());
+        s->landmark_cascade_ = landmark_cascade_;
+        s->profiling_ = profiling_;
+        s->capture_ = capture_;
+        s->tracer_ = tracer_;
+        s->stats_.landmark_layers.clear();
+        return s;
+    }
+
+    // per-op schedules follow the heads that run
+    void InferenceContext::set_outputs(int outputs){
+        outputs_ = outputs;
+        landmark_schedules_.clear();
+    }
+
+    void InferenceContext::set_max_faces(int max_faces, faceRank rank){
+        max_faces_ = max_faces;
+        face_rank_ = rank;
+    }
+
+    static int box_area(const bbox& b){
+        return (b.x2 - b.x1 + 1)*(b.y2 - b.y1 + 1);
+    }
+
+    int InferenceContext::select_faces(std::vector<bbox>& boxes) const{
+        if (max_faces_ <= 0 || static_cast<int>(boxes.size()) <= max_faces_) return 0;
+        if (face_rank_ == RankByArea)
+            std::partial_sort(boxes.begin(), boxes.begin() + max_faces_, boxes.end(),
+                              [](const bbox& a, const bbox& b) { return box_area(a) > box_area(b); });
+        else
+            std::partial_sort(boxes.begin(), boxes.begin() + max_faces_, boxes.end(),
+                              [](const bbox& a, const bbox& b) { return a.score > b.score; });
+        int dropped = static_cast<int>(boxes.size()) - max_faces_;
+        boxes.resize(max_faces_);
+        return dropped;
+    }
+
+    void InferenceContext::set_deadline(float deadline_ms, const std::vector<QualityLevel>& levels){
+        if (deadline_ms <= 0 || levels.empty()) {
+            if (!levels_.empty()) apply_settings(own_settings_);
+            deadline_ms_ = 0;
+            levels_.clear();
+            level_times_.clear();
+            step_ratios_.clear();
+            level_ = -1;
+            return;
+        }
+        for (size_t i = 0; i < levels.size(); ++i) {
+            assert(levels[i].input_width > 0 && levels[i].input_width % 16 == 0);
+            assert(levels[i].input_height > 0 && levels[i].input_height % 16 == 0);
+        }
+        if (levels_.empty()) {
+            QualityLevel own = {input_width_, input_height_, keyframe_interval_, max_faces_};
+            own_settings_ = own;
+        }
+        deadline_ms_ = deadline_ms;
+        levels_ = levels;
+        level_times_.assign(levels.size(), 0.0f);
+        step_ratios_.assign(levels.size(), 0.0f);
+        level_ = -1;
+        apply_quality(0);
+    }
+
+    void InferenceContext::apply_quality(int level){
+        apply_settings(levels_[level]);
+        previous_level_ = level_;
+        level_ = level;
+        frames_at_level_ = 0;
+    }
+
+    void InferenceContext::apply_settings(const QualityLevel& q){
+        input_width_ = q.input_width;
+        input_height_ = q.input_height;
+        // tracking changes the landmark heads, see landmark_outputs
+        if ((keyframe_interval_ > 1) != (q.keyframe_interval > 1)) landmark_schedules_.clear();
+        keyframe_interval_ = q.keyframe_interval;
+        max_faces_ = q.max_faces;
+    }
+
+    // The cost ratio of two neighbouring levels is measured right after a
+    // switch between them, when the load is about the same for both, so it
+    // still holds when the device later slows down or speeds up.
+    void InferenceContext::adapt_quality(float frame_ms){
+        if (levels_.empty()) return;
+        const float alpha = 0.2f;
+        const int ratio_frames = 5;
+        // a level must run this long before a better one is tried
+        const int settle_frames = 30;
+        const float headroom = 0.8f;
+        float& avg = level_times_[level_];
+        avg = frames_at_level_ ? avg + alpha*(frame_ms - avg) : frame_ms;
+        frames_at_level_++;
+
+        if (frames_at_level_ == ratio_frames && avg > 0) {
+            if (previous_level_ == level_ - 1)
+                step_ratios_[level_ - 1] = level_times_[level_ - 1]/avg;
+            else if (previous_level_ == level_ + 1)
+                step_ratios_[level_] = avg/level_times_[level_ + 1];
+        }
+        // the first frame at a level may still allocate its plan
+        if (avg > deadline_ms_ && frames_at_level_ >= 2 &&
+            level_ + 1 < static_cast<int>(levels_.size())) {
+            apply_quality(level_ + 1);
+        } else if (level_ > 0 && frames_at_level_ >= settle_frames) {
+            // without a measured ratio, assume the better level costs twice as much
+            float ratio = step_ratios_[level_ - 1] > 0 ? step_ratios_[level_ - 1] : 2.0f;
+            if (avg*ratio < headroom*deadline_ms_) apply_quality(level_ - 1);
+        }
+    }
+
+    void InferenceContext::set_tracking(int keyframe_interval){
+        keyframe_interval_ = keyframe_interval;
+        landmark_schedules_.clear();
+        TrackShape identity = {0.0f, 0.0f, 1.0f, 1.0f};
+        track_shape_ = identity;
+        reset_tracking();
+    }
+
+    void InferenceContext::reset_tracking(){
+        frames_since_keyframe_ = 0;
+        tracks_.clear();
+    }
+
+    void InferenceContext::set_input_size(int width, int height, resizeMode mode){
+        assert(width > 0 && width % 16 == 0);
+        assert(height > 0 && height % 16 == 0);
+        input_width_ = width;
+        input_height_ = height;
+        resize_mode_ = mode;
+    }
+
+    InputLayout InferenceContext::input_layout(int im_width, int im_height) const{
+        InputLayout layout;
+        layout.net_width = layout.width = input_width_;
+        layout.net_height = layout.height = input_height_;
+        if (resize_mode_ == Stretch) return layout;
+
+        float scale = (std::min)(static_cast<float>(input_width_)/im_width,
+                                 static_cast<float>(input_height_)/im_height);
+        layout.width = (std::max)(1, (std::min)(input_width_, static_cast<int>(im_width*scale + 0.5f)));
+        layout.height = (std::max)(1, (std::min)(input_height_, static_cast<int>(im_height*scale + 0.5f)));
+        if (resize_mode_ == KeepAspect) {
+            layout.net_width = layout.width = (std::max)(16, (layout.width + 8) / 16 * 16);
+            layout.net_height = layout.height = (std::max)(16, (layout.height + 8) / 16 * 16);
+        }
+        return layout;
+    }
+
+    void InferenceContext::clear_plans(){
+        for (std::map<PlanShape, DetectPlan*>::iterator it = plans_.begin();
+             it != plans_.end(); ++it) {
+            delete it->second;
+        }
+        plans_.clear();
+    }
+
+    InferenceContext::~InferenceContext(){
+        clear_plans();
+        for (size_t i = 0; i < landmark_blobs_.size(); ++i) {
+            delete landmark_blobs_[i];
+        }
+        destroy_pools();
+    }
+} //namespace  galaxy
@@ -0,0 +1,266 @@
+#ifndef CONTEXT_HPP_
+#define CONTEXT_HPP_
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+#include "blob.hpp"
+#include "math_functions.hpp"
+#include "profile.hpp"
+#include "threading.hpp"
+#include "threadpool.hpp"
+#include "trace.hpp"
+
+namespace  galaxy {
+    // How a frame is mapped onto the detector input:
+    //   Stretch    - resize to exactly width x height (aspect ratio is lost);
+    //   Letterbox  - keep aspect ratio inside width x height, pad with zeros;
+    //   KeepAspect - shrink width x height to the frame's aspect ratio, rounded
+    //                to multiples of 16, so no compute is spent on padding.
+    enum resizeMode {Stretch, Letterbox, KeepAspect};
+
+    // Which faces a face budget keeps: the highest scores or the largest
+    // boxes.
+    enum faceRank {RankByScore, RankByArea};
+
+    // LandmarkNet outputs, or-ed into a mask. A face's array() holds the
+    // requested point sets in this order: the 5 landmarks (10 floats), then
+    // the 70 animoji points (140 floats); it is NULL when neither is asked
+    // for. Without OutputScore, bbox::score keeps the detector's score;
+    // without OutputBox, the box is the square crop LandmarkNet saw. The
+    // classifier itself always runs, since it decides which faces are kept.
+    enum outputHead {
+        OutputScore = 1,
+        OutputBox = 2,
+        OutputLandmarks = 4,
+        OutputAnimoji = 8,
+        OutputAll = OutputScore | OutputBox | OutputLandmarks | OutputAnimoji
+    };
+
+    // Where a frame lands inside the detector input.
+    struct InputLayout {
+        int net_width, net_height;
+        int width, height;
+    };
+
+    // Key of the plans of a context; batch is the number of stacked frames.
+    struct PlanShape {
+        int width, height, batch;
+
+        bool operator<(const PlanShape& o) const {
+            if (width != o.width) return width < o.width;
+            if (height != o.height) return height < o.height;
+            return batch < o.batch;
+        }
+    };
+
+    // Pre-sized execution state for one detector input shape.
+    struct DetectPlan {
+        DetectPlan(int width, int height, int batch = 1);
+        ~DetectPlan();
+
+        int width;
+        int height;
+        int batch;
+        Blob* input;
+        std::vector<Blob*> blobs;
+        Workspace workspace;
+        // per-op pools from the context's thread policy; empty: uniform
+        std::vector<threadpool_t> op_pools;
+    };
+
+    // One step of the deadline mode's quality ladder.
+    struct QualityLevel {
+        int input_width, input_height;  // detector input, multiples of 16
+        int keyframe_interval;          // see set_tracking
+        int max_faces;                  // see set_max_faces
+    };
+
+    // Box geometry relative to the extent of a face's landmarks: center
+    // offset in extent units and size ratio, averaged over a keyframe.
+    struct TrackShape {
+        float dx, dy, sx, sy;
+    };
+
+    class DetectNet;
+    class LandmarkNet;
+    class Pipeline;
+
+    // Everything one predict() call writes: activations, NNPACK workspaces,
+    // thread pools, tracking state and timings. A context must not be used
+    // by two threads at once; give each worker its own context and share the
+    // Model.
+    class InferenceContext {
+        friend class DetectNet;
+        friend class LandmarkNet;
+        friend class Pipeline;
+    public:
+        // pool selects the thread pool behaviour, see PoolOptions
+        InferenceContext(int num_threads = -1, const PoolOptions& pool = PoolOptions());
+        // Runs on a pool shared with other contexts. The landmark stage and
+        // per-op thread counts use it too, so the context never creates
+        // threads of its own.
+        explicit InferenceContext(std::shared_ptr<SharedThreadPool> pool);
+        ~InferenceContext();
+
+        // width and height must be multiples of 16
+        void set_input_size(int width, int height, resizeMode mode = Stretch);
+        // Video tracking: the detector only runs every keyframe_interval
+        // frames, or as soon as a tracked face is lost; in between, face boxes
+        // are derived from the previous frame's landmarks and only LandmarkNet
+        // runs. An interval of 1 or less disables tracking.
+        void set_tracking(int keyframe_interval);
+        void reset_tracking();
+        // Speculative landmarks: on detector frames, LandmarkNet starts on the
+        // previous detections while the detector runs, on a persistent thread
+        // with its own share of the threads and its own landmark state. The
+        // result is kept when every new box matches a previous one with IoU
+        // above iou_thresh; otherwise landmarks are rerun on the detector
+        // pool. Contexts on a SharedThreadPool do not speculate.
+        void set_speculative(bool enable, float iou_thresh = 0.7f);
+        // Threads for LandmarkNet: 0 or less shares the detector pool (or
+        // half of the threads in speculative mode), 1 runs it inline. In
+        // speculative mode they are the speculative run's threads.
+        void set_landmark_threads(int num_threads);
+        // Landmark cascade: the box regression, landmark and animoji heads
+        // only run on the boxes the classifier head accepts, so rejected
+        // candidates cost the trunk alone. Results are unchanged; captured
+        // head outputs hold the accepted rows only.
+        void set_landmark_cascade(bool enable) { landmark_cascade_ = enable; }
+        // Heads LandmarkNet computes and stores, see outputHead. Tracking
+        // derives boxes from all 75 points, so it adds both point sets.
+        void set_outputs(int outputs);
+        int outputs() const { return outputs_; }
+        // Face budget: at most max_faces faces reach LandmarkNet, so a crowd
+        // cannot blow the frame time; 0 or less is unlimited. By score, the
+        // detector's NMS keeps at most max_faces boxes. The faces left out
+        // are counted in stats().dropped_faces; by score that is an upper
+        // bound, as NMS stops at the cap, see nms.
+        void set_max_faces(int max_faces, faceRank rank = RankByScore);
+        // Deadline mode: levels go from the best quality to the cheapest and
+        // replace the input size, tracking interval and face budget. Each
+        // predict feeds its time into a moving average; the context drops a
+        // level when the average exceeds deadline_ms, and returns to a better
+        // one once its predicted time, from the measured cost ratio of the
+        // two levels, fits with some headroom.
+        // deadline_ms <= 0 or no levels turns it off and restores the input
+        // size, tracking interval and face budget it started from.
+        // stats().quality_level tells the level.
+        void set_deadline(float deadline_ms, const std::vector<QualityLevel>& levels);
+        int quality_level() const { return level_; }
+
+        // Per-op thread counts for the detector, and for LandmarkNet while it
+        // shares the detector's pool; see threadPolicy. inline_small_ops lets
+        // ops too small to amortize a fork/join run on the calling thread.
+        void set_thread_policy(threadPolicy policy, bool inline_small_ops = true);
+        // Pins every pool thread of this context to cpus, e.g. the big
+        // cluster; empty leaves new pools unpinned.
+        void set_cpu_affinity(const std::vector<int>& cpus);
+
+        int num_threads() const { return num_threads_; }
+        threadpool_t threadpool() const { return threadpool_; }
+        threadpool_t landmark_threadpool() const { return landmark_pool_; }
+
+        // Per-layer timings and NNPACK phases in stats(); off by default.
+        // capture_outputs also copies every layer's output tensor.
+        void set_profiling(bool enable, bool capture_outputs = false) {
+            profiling_ = enable;
+            capture_ = enable && capture_outputs;
+        }
+        // Timeline events of every stage and op go to tracer; NULL stops.
+        void set_tracer(Tracer* tracer) { tracer_ = tracer; }
+        Tracer* tracer() const { return tracer_; }
+        // Timings of the last predict on this context.
+        const InferenceStats& stats() const { return stats_; }
+
+    protected:
+        InputLayout input_layout(int im_width, int im_height) const;
+        void create_pools();
+        void destroy_pools();
+        void clear_plans();
+        // box limit for the detector's NMS, 0 for none
+        int nms_max_keep() const {
+            return face_rank_ == RankByScore ? (std::max)(0, max_faces_) : 0;
+        }
+        // cuts boxes down to the face budget, returns the number cut
+        int select_faces(std::vector<bbox>& boxes) const;
+        void apply_quality(int level);
+        void apply_settings(const QualityLevel& q);
+        // deadline mode step after a predict that took frame_ms
+        void adapt_quality(float frame_ms);
+        // the requested outputs plus what tracking needs
+        int landmark_outputs() const {
+            return keyframe_interval_ > 1 ? outputs_ | OutputLandmarks | OutputAnimoji : outputs_;
+        }
+        // the context speculative landmarks run on, synced with this one's
+        // landmark settings; NULL when not speculating
+        InferenceContext* speculative_context();
+        // detector pool of the given size; 1 or less runs inline
+        InferenceContext(int num_threads, const PoolOptions& pool,
+                         std::shared_ptr<SharedThreadPool> shared);
+        threadpool_t pool_for(int threads);
+        std::vector<threadpool_t> resolve(const std::vector<int>& threads);
+        int detect_threads() const {
+            return threadpool_ ? static_cast<int>(threadpool_threads_count(threadpool_)) : 1;
+        }
+        std::vector<LayerStats>* detect_layers() {
+            return profiling_ ? &stats_.detect_layers : NULL;
+        }
+        std::vector<LayerStats>* landmark_layers() {
+            return profiling_ ? &stats_.landmark_layers : NULL;
+        }
+
+        int num_threads_;
+        PoolOptions pool_options_;
+        std::shared_ptr<SharedThreadPool> shared_pool_;
+        int landmark_threads_;
+        bool profiling_;
+        bool capture_;
+        InferenceStats stats_;
+        Tracer* tracer_;
+        threadpool_t threadpool_;
+        threadpool_t landmark_pool_;
+        threadPolicy thread_policy_;
+        bool inline_small_;
+        std::vector<int> cpus_;
+        std::map<int, threadpool_t> sized_pools_;
+        std::map<int, std::vector<threadpool_t> > landmark_schedules_;
+
+        std::map<PlanShape, DetectPlan*> plans_;
+        std::vector<Blob*> landmark_blobs_;
+        bool landmark_cascade_;
+        int outputs_;
+        int max_faces_;
+        faceRank face_rank_;
+        float deadline_ms_;
+        std::vector<QualityLevel> levels_;
+        // the settings the levels replaced, back when deadline mode stops
+        QualityLevel own_settings_;
+        // last moving average of each level, 0 until it ran
+        std::vector<float> level_times_;
+        // time of level i over level i + 1, 0 until measured
+        std::vector<float> step_ratios_;
+        int level_;
+        int previous_level_;
+        int frames_at_level_;
+        int input_width_;
+        int input_height_;
+        resizeMode resize_mode_;
+
+        int keyframe_interval_;
+        int frames_since_keyframe_;
+        TrackShape track_shape_;
+        std::vector<bbox> tracks_;
+
+        bool speculative_;
+        float speculative_iou_;
+        std::vector<bbox> prev_detections_;
+        InferenceContext* speculative_ctx_;
+        Worker* speculative_worker_;
+    private:
+        InferenceContext(const InferenceContext&);
+        InferenceContext& operator=(const InferenceContext&);
+    };
+} //namespace  galaxy
+#endif //CONTEXT_HPP_
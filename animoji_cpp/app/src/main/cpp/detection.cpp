@@ -1,13 +1,15 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 #include <memory>
 #include <thread>
 #include "math_functions.hpp"
+#include "simd.hpp"
 #include "detection.hpp"
 #include "landmark.hpp"
 
 using namespace std::chrono;
-float detect_time,landmark_time;
 namespace galaxy {
 
     static float anchors[10] = {
@@ -18,264 +20,643 @@ namespace galaxy {
         5.538638f,     8.54274f
     };
 
-    inline void sigmoid(float* a, int count){
-        for(int i = -count; i; ++i){
-            *a = *a > 20.0f ? 1.0f:(*a < -20.0f ? 0.0f:1.0f/(1.0f+exp(-*a)));
-            a++;
-        }
+    // sigmoid(x) > thresh  <=>  x > log(thresh/(1 - thresh)), so the
+    // confidence planes are scanned in logit space and only the surviving
+    // cells pay for exp().
+    inline float logit(float p){
+        return logf(p/(1.0f - p));
     }
 
+    // scale_width/scale_height are frame pixels per feature map cell; only
+    // the given image of a batched feature map is decoded
     std::vector<bbox> generate_bbox(const Blob* feature_map,
-                    const int im_height, const int im_width) {
+                    const float scale_width, const float scale_height,
+                    const int im_height, const int im_width, const int image,
+                    const int max_keep, int* dropped) {
 
-        int nbox = 5;
-        float thresh = 0.40f;
+        const int nbox = 5;
+        const float thresh = 0.40f;
+        static const float logit_thresh = logit(thresh);
         Shape shape = feature_map->shape();
-        int batch_size = shape[0];
+        assert(image < shape[0]);
         assert(shape[1] == 6*nbox);
         int height = shape[2];
         int width = shape[3];
         int step = height*width;
-        float scale_width = im_width/width;
-        float scale_height = im_height/height;
 
-        float* data = feature_map->data();
+        float* data = feature_map->data() + image*6*nbox*step;
         std::vector<bbox> boxes;
         boxes.reserve(step*nbox);
-        for (int bs = -batch_size; bs; ++bs){
-            for(int b = 0; b < nbox; ++b){
-                float* x = data;
-                float* y = x + step;
-                float* w = y + step;
-                float* h = w + step;
-                float* conf = h + step;
-                data = conf + 2*step;
-                sigmoid(conf, step);
-                int n = 0;
-                for (int i = 0; i < height; ++i){
-                    for(int j = 0; j < width; ++j){
-                        if(conf[n] > thresh){
-                            float xx = x[n] > 20.0f ? 1.0f:(x[n] < -20.0f? 0.0f:1.0f/(1.0f+exp(-x[n])));
-                            float yy = y[n] > 20.0f ? 1.0f:(y[n] < -20.0f? 0.0f:1.0f/(1.0f+exp(-y[n])));
-
-                            xx = scale_width*(xx + j);
-                            yy = scale_height*(yy + i);
-
-                            float ww = scale_width*(exp(w[n])*anchors[2 * b])*0.5f;
-                            float hh = scale_height*(exp(h[n])*anchors[2 * b + 1])*0.5f;
-
-                            register int x1 = (std::max)(0, static_cast<int>(xx - ww + 0.5f));
-                            register int y1 = (std::max)(0, static_cast<int>(yy - hh + 0.5f));
-                            register int x2 = (std::min)(im_width, static_cast<int>(xx + ww + 0.5f));
-                            register int y2 = (std::min)(im_height, static_cast<int>(yy + hh + 0.5f));
-                            if(x2 > x1 && y2 > y1)
-                                boxes.emplace_back(bbox(x1,y1,x2,y2,conf[n]));
-                        }
-                        n++;
-                    }
+        // survivors as b*step + n over the five anchor planes of one image
+        std::vector<int> cells(step*nbox + 4);
+        const v4f vthresh = v4f_set1(logit_thresh);
+        int ncells = 0;
+        for(int b = 0; b < nbox; ++b){
+            const float* conf = data + (6*b + 4)*step;
+            int n = 0;
+            for (; n + 4 <= step; n += 4){
+                int mask = v4f_gt_mask(v4f_load(conf + n), vthresh);
+                while (mask) {
+                    cells[ncells++] = b*step + n + __builtin_ctz(mask);
+                    mask &= mask - 1;
+                }
+            }
+            for (; n < step; ++n){
+                if (conf[n] > logit_thresh) cells[ncells++] = b*step + n;
+            }
+        }
+
+        // decode four survivors at a time; the tail is padded with zeros
+        float tx[4], ty[4], tw[4], th[4], tc[4], aw[4], ah[4];
+        for (int c = 0; c < ncells; c += 4){
+            int nc = (std::min)(4, ncells - c);
+            for (int l = 0; l < 4; ++l){
+                if (l < nc) {
+                    int b = cells[c + l] / step;
+                    int n = cells[c + l] - b*step;
+                    const float* x = data + 6*b*step + n;
+                    tx[l] = x[0];
+                    ty[l] = x[step];
+                    tw[l] = x[2*step];
+                    th[l] = x[3*step];
+                    tc[l] = x[4*step];
+                    aw[l] = anchors[2 * b];
+                    ah[l] = anchors[2 * b + 1];
+                }
+                else {
+                    tx[l] = ty[l] = tw[l] = th[l] = tc[l] = aw[l] = ah[l] = 0.0f;
                 }
             }
+            v4f_store(tx, v4f_sigmoid(v4f_load(tx)));
+            v4f_store(ty, v4f_sigmoid(v4f_load(ty)));
+            v4f_store(tc, v4f_sigmoid(v4f_load(tc)));
+            v4f_store(tw, v4f_mul(v4f_mul(v4f_exp(v4f_load(tw)), v4f_load(aw)),
+                                  v4f_set1(scale_width*0.5f)));
+            v4f_store(th, v4f_mul(v4f_mul(v4f_exp(v4f_load(th)), v4f_load(ah)),
+                                  v4f_set1(scale_height*0.5f)));
+
+            for (int l = 0; l < nc; ++l){
+                int n = cells[c + l] % step;
+                int i = n / width;
+                int j = n - i*width;
+                float xx = scale_width*(tx[l] + j);
+                float yy = scale_height*(ty[l] + i);
+                float ww = tw[l];
+                float hh = th[l];
+
+                register int x1 = (std::max)(0, static_cast<int>(xx - ww + 0.5f));
+                register int y1 = (std::max)(0, static_cast<int>(yy - hh + 0.5f));
+                register int x2 = (std::min)(im_width, static_cast<int>(xx + ww + 0.5f));
+                register int y2 = (std::min)(im_height, static_cast<int>(yy + hh + 0.5f));
+                if(x2 > x1 && y2 > y1)
+                    boxes.emplace_back(bbox(x1,y1,x2,y2,tc[l]));
+            }
         }
 
-        boxes.resize(boxes.size());
-        nms(boxes, 0.6, false);
+        nms(boxes, 0.6, false, max_keep, dropped);
         return boxes;
     }
 
-    void DetectNet::build_net(){
-        param_.reserve(28);
-        param_.push_back(new Blob(8, 3, 3, 3));
-        param_.push_back(new Blob(8));
-
-        param_.push_back(new Blob(12, 8, 3, 3));
-        param_.push_back(new Blob(12));
-
-        param_.push_back(new Blob(16, 12, 3, 3));
-        param_.push_back(new Blob(16));
-
-        param_.push_back(new Blob(8, 16, 1, 1));
-        param_.push_back(new Blob(8));
-
-        param_.push_back(new Blob(16, 8, 3, 3));
-        param_.push_back(new Blob(16));
-
-        param_.push_back(new Blob(32, 16, 3, 3));
-        param_.push_back(new Blob(32));
-
-        param_.push_back(new Blob(16, 32, 1, 1));
-        param_.push_back(new Blob(16));
+    DetectNet::DetectNet(int num_threads, const PoolOptions& pool)
+        :owned_model_(new Model), model_(owned_model_), landmarknet_(owned_model_.get()),
+         context_(num_threads, pool){
+    }
 
-        param_.push_back(new Blob(32, 16, 3, 3));
-        param_.push_back(new Blob(32));
+    DetectNet::DetectNet(std::shared_ptr<const Model> model, int num_threads,
+                         const PoolOptions& pool)
+        :model_(model), landmarknet_(model.get()), context_(num_threads, pool){
+        set_input_size(112, 112);
+    }
 
-        param_.push_back(new Blob(64, 32, 3, 3));
-        param_.push_back(new Blob(64));
+    DetectNet::DetectNet(std::shared_ptr<SharedThreadPool> pool)
+        :owned_model_(new Model), model_(owned_model_), landmarknet_(owned_model_.get()),
+         context_(pool){
+    }
 
-        param_.push_back(new Blob(32, 64, 1, 1));
-        param_.push_back(new Blob(32));
+    DetectNet::DetectNet(std::shared_ptr<const Model> model, std::shared_ptr<SharedThreadPool> pool)
+        :model_(model), landmarknet_(model.get()), context_(pool){
+        set_input_size(112, 112);
+    }
 
-        param_.push_back(new Blob(64, 32, 3, 3));
-        param_.push_back(new Blob(64));
+    // true when both sets have the same size and every box in a has its own
+    // partner in b with IoU above thresh
+    static bool boxes_agree(const std::vector<bbox>& a, const std::vector<bbox>& b, float thresh){
+        if (a.size() != b.size()) return false;
+        std::vector<bool> used(b.size(), false);
+        for (size_t i = 0; i < a.size(); ++i) {
+            int best = -1;
+            float best_iou = thresh;
+            for (size_t j = 0; j < b.size(); ++j) {
+                if (used[j]) continue;
+                float o = iou(a[i], b[j]);
+                if (o > best_iou) {
+                    best_iou = o;
+                    best = static_cast<int>(j);
+                }
+            }
+            if (best < 0) return false;
+            used[best] = true;
+        }
+        return true;
+    }
 
-        param_.push_back(new Blob(32, 64, 1, 1));
-        param_.push_back(new Blob(32));
+    // bounding box of the 5 + 70 landmarks stored in a face's array
+    static void landmark_extent(const bbox& face, float* x0, float* y0, float* x1, float* y1){
+        const float* p = face.array();
+        *x0 = *x1 = p[0];
+        *y0 = *y1 = p[1];
+        for (int l = 1; l < 75; ++l) {
+            *x0 = (std::min)(*x0, p[2*l]);
+            *x1 = (std::max)(*x1, p[2*l]);
+            *y0 = (std::min)(*y0, p[2*l + 1]);
+            *y1 = (std::max)(*y1, p[2*l + 1]);
+        }
+    }
 
-        param_.push_back(new Blob(64, 32, 3, 3));
-        param_.push_back(new Blob(64));
+    static void calibrate_tracking(const std::vector<bbox>& faces, TrackShape& track_shape){
+        TrackShape sum = {0.0f, 0.0f, 0.0f, 0.0f};
+        int n = 0;
+        for (size_t i = 0; i < faces.size(); ++i) {
+            const bbox& face = faces[i];
+            if (!face.array()) continue;
+            float x0, y0, x1, y1;
+            landmark_extent(face, &x0, &y0, &x1, &y1);
+            float ew = (std::max)(1.0f, x1 - x0);
+            float eh = (std::max)(1.0f, y1 - y0);
+            sum.dx += (0.5f*(face.x1 + face.x2) - 0.5f*(x0 + x1))/ew;
+            sum.dy += (0.5f*(face.y1 + face.y2) - 0.5f*(y0 + y1))/eh;
+            sum.sx += (face.x2 - face.x1)/ew;
+            sum.sy += (face.y2 - face.y1)/eh;
+            n++;
+        }
+        if (n == 0) return;
+        track_shape.dx = sum.dx/n;
+        track_shape.dy = sum.dy/n;
+        track_shape.sx = sum.sx/n;
+        track_shape.sy = sum.sy/n;
+    }
 
-        param_.push_back(new Blob(30, 64, 1, 1));
-        param_.push_back(new Blob(30));
+    static std::vector<bbox> track_boxes(const std::vector<bbox>& tracks,
+                                         const TrackShape& track_shape){
+        std::vector<bbox> boxes;
+        boxes.reserve(tracks.size());
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            const bbox& face = tracks[i];
+            float x0, y0, x1, y1;
+            landmark_extent(face, &x0, &y0, &x1, &y1);
+            float ew = x1 - x0;
+            float eh = y1 - y0;
+            float cx = 0.5f*(x0 + x1) + track_shape.dx*ew;
+            float cy = 0.5f*(y0 + y1) + track_shape.dy*eh;
+            float hw = 0.5f*track_shape.sx*ew;
+            float hh = 0.5f*track_shape.sy*eh;
+            boxes.push_back(bbox(static_cast<int>(cx - hw + 0.5f), static_cast<int>(cy - hh + 0.5f),
+                                 static_cast<int>(cx + hw + 0.5f), static_cast<int>(cy + hh + 0.5f),
+                                 face.score));
+        }
+        return boxes;
+    }
 
-        blobs_.resize(18);
-#ifdef _DEBUG
-        for (int i = 0; i < 18; ++i)
-            assert(!blobs_[i]);
-#endif
+    void DetectNet::set_input_size(int width, int height, resizeMode mode){
+        context_.set_input_size(width, height, mode);
+        if (mode != KeepAspect) prepare(context_, width, height);
     }
 
-    DetectNet::DetectNet(int num_threads){
-        enum nnp_status init_status = nnp_initialize();
-        if (init_status != nnp_status_success) {
-                fprintf(stderr, "Initialization failed: error code %d\n", init_status);
-            exit(EXIT_FAILURE);
+    void DetectNet::set_deadline(float deadline_ms, const std::vector<QualityLevel>& levels){
+        context_.set_deadline(deadline_ms, levels);
+        if (context_.resize_mode_ == KeepAspect) return;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            prepare(context_, levels[i].input_width, levels[i].input_height);
         }
+    }
+
+    void DetectNet::prepare(InferenceContext& ctx, int width, int height) const{
+        get_plan(ctx, width, height);
+    }
 
-        int nMaxThreads = std::thread::hardware_concurrency();
-        int nThreads;
-        if((num_threads <=0 || num_threads > nMaxThreads)){
-            nThreads = nMaxThreads;
+    // Plans are created on first use of a shape and kept for the lifetime of
+    // the context. The first forward pass on the zeroed input allocates every
+    // blob and sizes the shared workspace, so later frames allocate nothing;
+    // its per-op record also feeds the thread policy.
+    DetectPlan* DetectNet::get_plan(InferenceContext& ctx, int width, int height, int batch) const{
+        PlanShape key = {width, height, batch};
+        std::map<PlanShape, DetectPlan*>::iterator it = ctx.plans_.find(key);
+        if (it != ctx.plans_.end()) return it->second;
+
+        DetectPlan* plan = new DetectPlan(width, height, batch);
+        const std::vector<ArenaSize>& arenas = model_->arenas();
+        for (size_t i = 0; i < arenas.size(); ++i) {
+            if (batch == 1 && arenas[i].width == width && arenas[i].height == height)
+                plan->workspace.reserve(arenas[i].workspace);
         }
-        else{
-            nThreads = num_threads;
+        std::vector<LayerStats> ops;
+        forward(plan->input, plan, ctx.threadpool(), NULL, &ops);
+        plan->workspace.planned = true;
+        if (ctx.thread_policy_ == CostModelThreads) {
+            plan->op_pools = ctx.resolve(cost_model_threads(ops, ctx.detect_threads(),
+                                                            ctx.inline_small_));
+        } else if (ctx.thread_policy_ == CalibratedThreads) {
+            std::vector<int> threads = calibrate_threads(
+                    thread_candidates(ctx.detect_threads()), 5,
+                    [&](int n, std::vector<LayerStats>* run_ops) {
+                        forward(plan->input, plan, ctx.pool_for(n), NULL, run_ops);
+                    });
+            plan->op_pools = ctx.resolve(threads);
         }
-//        printf("nThreads = %d \n", nThreads);
-        threadpool_ = pthreadpool_create(nThreads);
-        build_net();
-        landmarknet_ = new LandmarkNet(threadpool_);
+        ctx.plans_[key] = plan;
+        return plan;
     }
 
+    // Shared models are loaded by their owner.
     void DetectNet::load_weight(const std::string& model_path) {
-        std::ifstream infile(model_path.c_str(), std::ifstream::binary);
-        if (!infile.is_open()) {
-            std::cout << "Open file fail: " << model_path << std::endl;
-            exit(1);
+        assert(owned_model_);
+        if (Model::is_snapshot(model_path)) {
+            owned_model_ = Model::load_snapshot(model_path);
+            if (!owned_model_) exit(EXIT_FAILURE);
+            model_ = owned_model_;
+            landmarknet_ = LandmarkNet(owned_model_.get());
+        } else {
+            owned_model_->load_weight(model_path);
         }
-        for (size_t i = 0; i < param_.size(); ++i) {
-            infile.read((char*)param_[i]->data(), param_[i]->count()*sizeof(float));
-            assert(infile.gcount() == param_[i]->count()*sizeof(float));
+        // plans sized before the kernel transforms existed need new workspaces
+        context_.clear_plans();
+        set_input_size(context_.input_width_, context_.input_height_, context_.resize_mode_);
+    }
+
+    void DetectNet::save_snapshot(const std::string& path) const{
+        std::vector<ArenaSize> arenas;
+        for (std::map<PlanShape, DetectPlan*>::const_iterator it = context_.plans_.begin();
+             it != context_.plans_.end(); ++it) {
+            // batched plans are sized on demand
+            if (it->first.batch != 1) continue;
+            ArenaSize a = {it->first.width, it->first.height, it->second->workspace.size};
+            arenas.push_back(a);
         }
-        landmarknet_->load_weight(infile);
-        infile.close();
+        model_->save_snapshot(path, arenas);
     }
 
     void DetectNet::forward(const Blob* input){
-        conv_forward(input, blobs_[0], param_[0], param_[1], threadpool_,
-                1, 1, 1, false);
-
-        cnn_maxpooling(blobs_[0], blobs_[1], 2, 2, threadpool_, None);
-        leaky(blobs_[1], threadpool_);
-
-        conv_forward(blobs_[1], blobs_[2], param_[2], param_[3], threadpool_,
-                1, 1, 1, false);
-
-        cnn_maxpooling(blobs_[2], blobs_[3], 2, 2, threadpool_, None);
-        leaky(blobs_[3], threadpool_);
-
-        conv_forward(blobs_[3], blobs_[4], param_[4], param_[5], threadpool_,
-                1, 1, 1, false);
-        leaky(blobs_[4], threadpool_);
-
-        conv_forward(blobs_[4], blobs_[5], param_[6], param_[7], threadpool_,
-                0, 0, 1, false);
-        leaky(blobs_[5], threadpool_);
-
-        conv_forward(blobs_[5], blobs_[6], param_[8], param_[9], threadpool_,
-                1, 1, 1, false);
-
-        cnn_maxpooling(blobs_[6], blobs_[7], 2, 2, threadpool_, None);
-        leaky(blobs_[7], threadpool_);
-
-        conv_forward(blobs_[7], blobs_[8], param_[10], param_[11], threadpool_,
-                1, 1, 1, false);
-        leaky(blobs_[8], threadpool_);
-
-        conv_forward(blobs_[8], blobs_[9], param_[12], param_[13], threadpool_,
-                0, 0, 1, false);
-        leaky(blobs_[9], threadpool_);
-
-        conv_forward(blobs_[9], blobs_[10], param_[14], param_[15], threadpool_,
-                1, 1, 1, false);
-
-        cnn_maxpooling(blobs_[10], blobs_[11], 2, 2, threadpool_, None);
-        leaky(blobs_[11], threadpool_);
-
-        conv_forward(blobs_[11], blobs_[12], param_[16], param_[17], threadpool_,
-                1, 1, 1, false);
-        leaky(blobs_[12], threadpool_);
-
-        conv_forward(blobs_[12], blobs_[13], param_[18], param_[19], threadpool_,
-                0, 0, 1, false);
-        leaky(blobs_[13], threadpool_);
-
-        conv_forward(blobs_[13], blobs_[14], param_[20], param_[21], threadpool_,
-                1, 1, 1, false);
-        leaky(blobs_[14], threadpool_);
-
-        conv_forward(blobs_[14], blobs_[15], param_[22], param_[23], threadpool_,
-                0, 0, 1, false);
-        leaky(blobs_[15], threadpool_);
+        forward(input, context_);
+    }
 
-        conv_forward(blobs_[15], blobs_[16], param_[24], param_[25], threadpool_,
-                1, 1, 1, false);
-        leaky(blobs_[16], threadpool_);
+    void DetectNet::forward(const Blob* input, InferenceContext& ctx) const{
+        forward(input, get_plan(ctx, input->shape(3), input->shape(2), input->shape(0)),
+                ctx.threadpool(), &ctx);
+    }
 
-        conv_forward(blobs_[16], blobs_[17], param_[26], param_[27], threadpool_,
-                0, 0, 1, false);
+    void DetectNet::forward(const Blob* input, DetectPlan* plan, threadpool_t threadpool,
+                            InferenceContext* ctx, std::vector<LayerStats>* ops) const{
+        Tracer* tracer = ctx ? ctx->tracer_ : NULL;
+        TraceScope trace(tracer, "forward", "detect");
+        const std::vector<Blob*>& param = model_->detect_param();
+        const std::vector<Blob*>& transform = model_->detect_transform();
+        const std::vector<SparseWeights*>& sparse = model_->detect_sparse();
+        std::vector<Blob*>& blobs = plan->blobs;
+        Workspace* workspace = &plan->workspace;
+        LayerProfiler prof(ops ? ops : (ctx ? ctx->detect_layers() : NULL), tracer, "detect",
+                           !ops && ctx && ctx->capture_);
+        OpThreads threads(threadpool, plan->op_pools.empty() ? NULL : &plan->op_pools);
+        conv_forward(input, blobs[0], param[0], param[1], threads.next(),
+                1, 1, 1, false, workspace, transform[0], prof.nnpack(), sparse[0]);
+        prof.record("conv", input, blobs[0]);
+
+        cnn_maxpooling(blobs[0], blobs[1], 2, 2, threads.next(), None);
+        prof.record("maxpool", blobs[0], blobs[1]);
+        leaky(blobs[1], threads.next());
+        prof.record("leaky", blobs[1], blobs[1]);
+
+        conv_forward(blobs[1], blobs[2], param[2], param[3], threads.next(),
+                1, 1, 1, false, workspace, transform[2], prof.nnpack(), sparse[2]);
+        prof.record("conv", blobs[1], blobs[2]);
+
+        cnn_maxpooling(blobs[2], blobs[3], 2, 2, threads.next(), None);
+        prof.record("maxpool", blobs[2], blobs[3]);
+        leaky(blobs[3], threads.next());
+        prof.record("leaky", blobs[3], blobs[3]);
+
+        conv_forward(blobs[3], blobs[4], param[4], param[5], threads.next(),
+                1, 1, 1, false, workspace, transform[4], prof.nnpack(), sparse[4]);
+        prof.record("conv", blobs[3], blobs[4]);
+        leaky(blobs[4], threads.next());
+        prof.record("leaky", blobs[4], blobs[4]);
+
+        conv_forward(blobs[4], blobs[5], param[6], param[7], threads.next(),
+                0, 0, 1, false, workspace, transform[6], prof.nnpack(), sparse[6]);
+        prof.record("conv", blobs[4], blobs[5]);
+        leaky(blobs[5], threads.next());
+        prof.record("leaky", blobs[5], blobs[5]);
+
+        conv_forward(blobs[5], blobs[6], param[8], param[9], threads.next(),
+                1, 1, 1, false, workspace, transform[8], prof.nnpack(), sparse[8]);
+        prof.record("conv", blobs[5], blobs[6]);
+
+        cnn_maxpooling(blobs[6], blobs[7], 2, 2, threads.next(), None);
+        prof.record("maxpool", blobs[6], blobs[7]);
+        leaky(blobs[7], threads.next());
+        prof.record("leaky", blobs[7], blobs[7]);
+
+        conv_forward(blobs[7], blobs[8], param[10], param[11], threads.next(),
+                1, 1, 1, false, workspace, transform[10], prof.nnpack(), sparse[10]);
+        prof.record("conv", blobs[7], blobs[8]);
+        leaky(blobs[8], threads.next());
+        prof.record("leaky", blobs[8], blobs[8]);
+
+        conv_forward(blobs[8], blobs[9], param[12], param[13], threads.next(),
+                0, 0, 1, false, workspace, transform[12], prof.nnpack(), sparse[12]);
+        prof.record("conv", blobs[8], blobs[9]);
+        leaky(blobs[9], threads.next());
+        prof.record("leaky", blobs[9], blobs[9]);
+
+        conv_forward(blobs[9], blobs[10], param[14], param[15], threads.next(),
+                1, 1, 1, false, workspace, transform[14], prof.nnpack(), sparse[14]);
+        prof.record("conv", blobs[9], blobs[10]);
+
+        cnn_maxpooling(blobs[10], blobs[11], 2, 2, threads.next(), None);
+        prof.record("maxpool", blobs[10], blobs[11]);
+        leaky(blobs[11], threads.next());
+        prof.record("leaky", blobs[11], blobs[11]);
+
+        conv_forward(blobs[11], blobs[12], param[16], param[17], threads.next(),
+                1, 1, 1, false, workspace, transform[16], prof.nnpack(), sparse[16]);
+        prof.record("conv", blobs[11], blobs[12]);
+        leaky(blobs[12], threads.next());
+        prof.record("leaky", blobs[12], blobs[12]);
+
+        conv_forward(blobs[12], blobs[13], param[18], param[19], threads.next(),
+                0, 0, 1, false, workspace, transform[18], prof.nnpack(), sparse[18]);
+        prof.record("conv", blobs[12], blobs[13]);
+        leaky(blobs[13], threads.next());
+        prof.record("leaky", blobs[13], blobs[13]);
+
+        conv_forward(blobs[13], blobs[14], param[20], param[21], threads.next(),
+                1, 1, 1, false, workspace, transform[20], prof.nnpack(), sparse[20]);
+        prof.record("conv", blobs[13], blobs[14]);
+        leaky(blobs[14], threads.next());
+        prof.record("leaky", blobs[14], blobs[14]);
+
+        conv_forward(blobs[14], blobs[15], param[22], param[23], threads.next(),
+                0, 0, 1, false, workspace, transform[22], prof.nnpack(), sparse[22]);
+        prof.record("conv", blobs[14], blobs[15]);
+        leaky(blobs[15], threads.next());
+        prof.record("leaky", blobs[15], blobs[15]);
+
+        conv_forward(blobs[15], blobs[16], param[24], param[25], threads.next(),
+                1, 1, 1, false, workspace, transform[24], prof.nnpack(), sparse[24]);
+        prof.record("conv", blobs[15], blobs[16]);
+        leaky(blobs[16], threads.next());
+        prof.record("leaky", blobs[16], blobs[16]);
+
+        conv_forward(blobs[16], blobs[17], param[26], param[27], threads.next(),
+                0, 0, 1, false, workspace, transform[26], prof.nnpack(), sparse[26]);
+        prof.record("conv", blobs[16], blobs[17]);
     }
 
-        std::vector<bbox> DetectNet::predict(const cv::Mat& im){
-//            std::cout << im.rows << " " << im.cols << std::endl;
-        //detect begin
-            high_resolution_clock::time_point Detect_BeginTime,Detect_EndTime,Landmark_BeginTime,Landmark_EndTime;
-            Detect_BeginTime= high_resolution_clock::now();
-            const int input_dim = 112;
+        // cv::resize does its own threading, so the pool is unused here
+        void DetectNet::fill_input(const cv::Mat& im, Blob* input, const InputLayout& layout,
+                                   threadpool_t) const{
             cv::Mat dst;
-            cv::resize(im, dst, cv::Size(input_dim, input_dim), CV_INTER_LINEAR);
+            cv::resize(im, dst, cv::Size(layout.width, layout.height), CV_INTER_LINEAR);
             std::vector<cv::Mat> bgr;
             cv::split(dst, bgr);
-            Blob* input = new Blob(1, 3, input_dim, input_dim);
+            // letterbox padding is left untouched; callers clear it
             float* data = input->data();
-            cv::Mat tmp_mat(cv::Size(input_dim, input_dim), CV_32FC1, data);
+            size_t row_step = layout.net_width*sizeof(float);
+            cv::Mat tmp_mat(cv::Size(layout.width, layout.height), CV_32FC1, data, row_step);
             for(int i = 3; i; --i){
                 bgr[i-1].convertTo(tmp_mat, CV_32FC1, 1.0f/255);
-                data += input_dim*input_dim;
+                data += layout.net_width*layout.net_height;
                 tmp_mat.data = static_cast<uchar *>((void*)data);
             }
+        }
+
+        void DetectNet::fill_input(const ImageView& im, Blob* input, const InputLayout& layout,
+                                   threadpool_t threadpool) const{
+            // channels are stored R, G, B like the cv::Mat path above
+            crop_resize_normalize(im, 0, 0, im.width, im.height, input->data(),
+                                  layout.width, layout.height, layout.net_width,
+                                  layout.net_width*layout.net_height, true,
+                                  1.0f/255, 0.0f, threadpool);
+        }
+
+        std::vector<bbox> DetectNet::decode(const DetectPlan* plan, const InputLayout& layout,
+                                            int im_width, int im_height, int image,
+                                            int max_keep, int* dropped) const{
+            const Blob* feature_map = plan->blobs[17];
+            float scale_width = static_cast<float>(layout.net_width)/feature_map->shape(3)
+                                *im_width/layout.width;
+            float scale_height = static_cast<float>(layout.net_height)/feature_map->shape(2)
+                                 *im_height/layout.height;
+            return generate_bbox(feature_map, scale_width, scale_height, im_height, im_width, image,
+                                 max_keep, dropped);
+        }
+
+        template <typename Image>
+        std::vector<bbox> DetectNet::detect(const Image& im, int im_width, int im_height,
+                                            InferenceContext& ctx) const{
+            InputLayout layout = ctx.input_layout(im_width, im_height);
+            DetectPlan* plan = get_plan(ctx, layout.net_width, layout.net_height);
+            high_resolution_clock::time_point t0 = high_resolution_clock::now();
+            {
+                TraceScope trace(ctx.tracer_, "preprocess", "detect");
+                // plans are shared by every layout of one net size, so the
+                // padding may still hold the previous frame
+                if (layout.width != layout.net_width || layout.height != layout.net_height)
+                    memset(plan->input->data(), 0, plan->input->count()*sizeof(float));
+                fill_input(im, plan->input, layout, ctx.threadpool());
+            }
+            high_resolution_clock::time_point t1 = high_resolution_clock::now();
+            forward(plan->input, plan, ctx.threadpool(), &ctx);
+            high_resolution_clock::time_point t2 = high_resolution_clock::now();
+            std::vector<bbox> boxes;
+            {
+                TraceScope trace(ctx.tracer_, "decode", "detect");
+                int dropped;
+                boxes = decode(plan, layout, im_width, im_height, 0, ctx.nms_max_keep(), &dropped);
+                ctx.stats_.dropped_faces += dropped;
+            }
+            high_resolution_clock::time_point t3 = high_resolution_clock::now();
+            ctx.stats_.preprocess_time = (float)duration_cast<microseconds>(t1 - t0).count()*1e-3;
+            ctx.stats_.forward_time = (float)duration_cast<microseconds>(t2 - t1).count()*1e-3;
+            ctx.stats_.decode_time = (float)duration_cast<microseconds>(t3 - t2).count()*1e-3;
+            return boxes;
+        }
 
-            forward(input);
-            delete input;
-            std::vector<bbox> boxes = generate_bbox(blobs_[17], im.rows, im.cols);
+        template <typename Image>
+        std::vector<bbox> DetectNet::run(const Image& im, int im_width, int im_height,
+                                         InferenceContext& ctx) const{
+            high_resolution_clock::time_point Detect_BeginTime,Detect_EndTime,Landmark_BeginTime,Landmark_EndTime;
+            high_resolution_clock::time_point begin = high_resolution_clock::now();
+            TraceScope trace(ctx.tracer_, "predict", "frame");
+            ctx.stats_.quality_level = ctx.level_;
+            ctx.stats_.detect_layers.clear();
+            ctx.stats_.landmark_layers.clear();
+            ctx.stats_.dropped_faces = 0;
+            bool tracking = ctx.keyframe_interval_ > 1;
+            bool keyframe = !tracking || ctx.tracks_.empty() ||
+                            ctx.frames_since_keyframe_ >= ctx.keyframe_interval_;
+            std::vector<bbox> boxes;
+            if (!keyframe) {
+                boxes = track_boxes(ctx.tracks_, ctx.track_shape_);
+                ctx.stats_.dropped_faces += ctx.select_faces(boxes);
+                ctx.stats_.detect_time = 0;
+                ctx.stats_.preprocess_time = ctx.stats_.forward_time = ctx.stats_.decode_time = 0;
+                Landmark_BeginTime=high_resolution_clock::now();
+                landmarknet_.predict(im, boxes, ctx);
+                Landmark_EndTime=high_resolution_clock::now();
+                ctx.stats_.landmark_time = (float)duration_cast<microseconds>(Landmark_EndTime - Landmark_BeginTime).count()*1e-3;
+                // a face fell under the classifier threshold: re-detect this frame
+                if (boxes.size() < ctx.tracks_.size()) keyframe = true;
+                else ctx.frames_since_keyframe_++;
+            }
+            if (keyframe) {
+                std::vector<bbox> speculative;
+                InferenceContext* spec = ctx.speculative_context();
+                bool pending = spec && !ctx.prev_detections_.empty();
+                if (pending) {
+                    speculative = ctx.prev_detections_;
+                    ctx.speculative_worker_->start(
+                            [this, &im, &speculative, spec](){ landmarknet_.predict(im, speculative, *spec); });
+                }
+        //detect begin
+                Detect_BeginTime= high_resolution_clock::now();
+                boxes = detect(im, im_width, im_height, ctx);
+                ctx.stats_.dropped_faces += ctx.select_faces(boxes);
         //detect end
-            Detect_EndTime=high_resolution_clock::now();
-            detect_time = (float)duration_cast<microseconds>(Detect_EndTime - Detect_BeginTime).count()*1e-3;
+                Detect_EndTime=high_resolution_clock::now();
+                ctx.stats_.detect_time = (float)duration_cast<microseconds>(Detect_EndTime - Detect_BeginTime).count()*1e-3;
         //landmark begin
-            Landmark_BeginTime=high_resolution_clock::now();
-            if (boxes.size() > 0) landmarknet_->predict(im, boxes);
-            Landmark_EndTime=high_resolution_clock::now();
+                Landmark_BeginTime=high_resolution_clock::now();
+                bool reuse = false;
+                if (pending) {
+                    ctx.speculative_worker_->wait();
+                    reuse = boxes_agree(boxes, ctx.prev_detections_, ctx.speculative_iou_);
+                }
+                if (spec) ctx.prev_detections_ = boxes;
+                if (reuse) {
+                    boxes.swap(speculative);
+                    ctx.stats_.landmark_layers = spec->stats_.landmark_layers;
+                }
+                else if (boxes.size() > 0) landmarknet_.predict(im, boxes, ctx);
+                Landmark_EndTime=high_resolution_clock::now();
         //landmark end
-            landmark_time = (float)duration_cast<microseconds>(Landmark_EndTime - Landmark_BeginTime).count()*1e-3;
+                ctx.stats_.landmark_time = (float)duration_cast<microseconds>(Landmark_EndTime - Landmark_BeginTime).count()*1e-3;
+                if (tracking) calibrate_tracking(boxes, ctx.track_shape_);
+                ctx.frames_since_keyframe_ = 1;
+            }
+            if (tracking) ctx.tracks_ = boxes;
+            ctx.adapt_quality((float)duration_cast<microseconds>(
+                    high_resolution_clock::now() - begin).count()*1e-3);
             return boxes;
         }
 
-        DetectNet::~DetectNet(){
-            delete landmarknet_;
-            for (size_t i = 0; i < blobs_.size(); ++i) {
-                delete blobs_[i];
+        std::vector<bbox> DetectNet::predict(const cv::Mat& im){
+            return run(im, im.cols, im.rows, context_);
+        }
+
+        std::vector<bbox> DetectNet::predict(const ImageView& im){
+            return run(im, im.width, im.height, context_);
+        }
+
+        std::vector<bbox> DetectNet::predict(const unsigned char* y, int y_stride,
+                                             const unsigned char* uv, int uv_stride,
+                                             int width, int height, pixelFormat format){
+            return predict(make_view(y, y_stride, uv, uv_stride, width, height, format));
+        }
+
+        std::vector<bbox> DetectNet::predict(const unsigned char* y, int y_stride,
+                                             const unsigned char* u, int u_stride,
+                                             const unsigned char* v, int v_stride,
+                                             int width, int height){
+            return predict(make_view(y, y_stride, u, u_stride, v, v_stride, width, height));
+        }
+
+        std::vector<bbox> DetectNet::predict(const cv::Mat& im, InferenceContext& ctx) const{
+            return run(im, im.cols, im.rows, ctx);
+        }
+
+        std::vector<bbox> DetectNet::predict(const ImageView& im, InferenceContext& ctx) const{
+            return run(im, im.width, im.height, ctx);
+        }
+
+        std::vector<std::vector<bbox> > DetectNet::predict(const std::vector<cv::Mat>& ims){
+            return predict(ims, context_);
+        }
+
+        std::vector<std::vector<bbox> > DetectNet::predict(const std::vector<cv::Mat>& ims,
+                                                           InferenceContext& ctx) const{
+            TraceScope trace(ctx.tracer_, "predict", "batch");
+            ctx.stats_.detect_layers.clear();
+            ctx.stats_.landmark_layers.clear();
+            ctx.stats_.dropped_faces = 0;
+            ctx.stats_.quality_level = ctx.level_;
+            const int n = static_cast<int>(ims.size());
+            std::vector<std::vector<bbox> > faces(n);
+            if (n == 0) return faces;
+            std::vector<InputLayout> layouts(n);
+            bool stackable = true;
+            for (int i = 0; i < n; ++i) {
+                layouts[i] = ctx.input_layout(ims[i].cols, ims[i].rows);
+                stackable = stackable && layouts[i].net_width == layouts[0].net_width
+                            && layouts[i].net_height == layouts[0].net_height;
+            }
+
+            high_resolution_clock::time_point t0 = high_resolution_clock::now();
+            if (!stackable) {
+                // KeepAspect frames of different shapes cannot share an input;
+                // each detect() sets the stage times of its own image
+                float preprocess_ms = 0, forward_ms = 0, decode_ms = 0;
+                for (int i = 0; i < n; ++i) {
+                    faces[i] = detect(ims[i], ims[i].cols, ims[i].rows, ctx);
+                    preprocess_ms += ctx.stats_.preprocess_time;
+                    forward_ms += ctx.stats_.forward_time;
+                    decode_ms += ctx.stats_.decode_time;
+                }
+                ctx.stats_.preprocess_time = preprocess_ms;
+                ctx.stats_.forward_time = forward_ms;
+                ctx.stats_.decode_time = decode_ms;
+            } else {
+                const int net_width = layouts[0].net_width;
+                const int net_height = layouts[0].net_height;
+                DetectPlan* plan = get_plan(ctx, net_width, net_height, n);
+                high_resolution_clock::time_point t1 = high_resolution_clock::now();
+                {
+                    TraceScope trace(ctx.tracer_, "preprocess", "detect");
+                    const int size = 3*net_width*net_height;
+                    for (int i = 0; i < n; ++i) {
+                        const InputLayout& layout = layouts[i];
+                        Blob image({1, 3, net_height, net_width}, plan->input->data() + i*size);
+                        // the previous call may have left another layout here
+                        if (layout.width != net_width || layout.height != net_height)
+                            memset(image.data(), 0, size*sizeof(float));
+                        fill_input(ims[i], &image, layout, ctx.threadpool());
+                    }
+                }
+                high_resolution_clock::time_point t2 = high_resolution_clock::now();
+                forward(plan->input, plan, ctx.threadpool(), &ctx);
+                high_resolution_clock::time_point t3 = high_resolution_clock::now();
+                {
+                    TraceScope trace(ctx.tracer_, "decode", "detect");
+                    for (int i = 0; i < n; ++i) {
+                        int dropped;
+                        faces[i] = decode(plan, layouts[i], ims[i].cols, ims[i].rows, i,
+                                          ctx.nms_max_keep(), &dropped);
+                        ctx.stats_.dropped_faces += dropped;
+                    }
+                }
+                high_resolution_clock::time_point t4 = high_resolution_clock::now();
+                ctx.stats_.preprocess_time = (float)duration_cast<microseconds>(t2 - t1).count()*1e-3;
+                ctx.stats_.forward_time = (float)duration_cast<microseconds>(t3 - t2).count()*1e-3;
+                ctx.stats_.decode_time = (float)duration_cast<microseconds>(t4 - t3).count()*1e-3;
             }
-            for (size_t i = 0; i < param_.size(); ++i) {
-                delete param_[i];
+            // the budget applies per image
+            for (int i = 0; i < n; ++i) {
+                ctx.stats_.dropped_faces += ctx.select_faces(faces[i]);
             }
-        if(0 != pthreadpool_get_threads_count(threadpool_))
-            pthreadpool_destroy(threadpool_);
+            high_resolution_clock::time_point t5 = high_resolution_clock::now();
+            landmarknet_.predict(ims, faces, ctx);
+            high_resolution_clock::time_point t6 = high_resolution_clock::now();
+            ctx.stats_.detect_time = (float)duration_cast<microseconds>(t5 - t0).count()*1e-3;
+            ctx.stats_.landmark_time = (float)duration_cast<microseconds>(t6 - t5).count()*1e-3;
+            return faces;
         }
 } // galaxy
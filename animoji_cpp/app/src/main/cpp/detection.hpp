@@ -2,31 +2,113 @@
 #define DETECTION_HPP_
 
 #include <vector>
-#include <fstream>
+#include <memory>
+#include <string>
 #include <opencv2/opencv.hpp>
 #include "blob.hpp"
+#include "math_functions.hpp"
 #include <nnpack.h>
-#include <pthreadpool.h>
+#include "context.hpp"
+#include "image_utils.hpp"
 #include "landmark.hpp"
+#include "model.hpp"
 
 namespace  galaxy {
+    class Pipeline;
+
+    // Runs the detector and LandmarkNet of a shared Model. The const
+    // predict(im, ctx) overloads keep all mutable state in the context, so
+    // several threads can call them on one DetectNet with a context each.
+    // The overloads without a context use the net's own default context.
     class DetectNet {
+        friend class Pipeline;
     public:
-        DetectNet(int num_threads = -1);
-        void build_net();
-        void forward(const Blob* input);
+        // Owns a fresh Model; call load_weight before predicting. pool picks
+        // galaxy's thread pool or the stock pthreadpool, see PoolOptions.
+        DetectNet(int num_threads = -1, const PoolOptions& pool = PoolOptions());
+        // Shares an already loaded Model.
+        DetectNet(std::shared_ptr<const Model> model, int num_threads = -1,
+                  const PoolOptions& pool = PoolOptions());
+        // The same, on a thread pool shared with other instances, e.g.
+        // SharedThreadPool::global(), instead of a thread budget of its own.
+        explicit DetectNet(std::shared_ptr<SharedThreadPool> pool);
+        DetectNet(std::shared_ptr<const Model> model, std::shared_ptr<SharedThreadPool> pool);
+        // Accepts the raw .bin weights or a snapshot (see Model).
         void load_weight(const std::string& model_path);
+        // Writes the model as a snapshot, with the arena sizes of the
+        // default context's plans.
+        void save_snapshot(const std::string& path) const;
+        const std::shared_ptr<const Model>& model() const { return model_; }
+        InferenceContext& context() { return context_; }
+
+        void forward(const Blob* input);
+        void forward(const Blob* input, InferenceContext& ctx) const;
+        // Allocates ctx's buffers for a width x height detector input ahead
+        // of the first frame.
+        void prepare(InferenceContext& ctx, int width, int height) const;
+
+        // Shorthands for the default context, see InferenceContext.
+        void set_input_size(int width, int height, resizeMode mode = Stretch);
+        void set_tracking(int keyframe_interval) { context_.set_tracking(keyframe_interval); }
+        void reset_tracking() { context_.reset_tracking(); }
+        void set_speculative(bool enable, float iou_thresh = 0.7f) {
+            context_.set_speculative(enable, iou_thresh);
+        }
+        void set_landmark_cascade(bool enable) { context_.set_landmark_cascade(enable); }
+        void set_outputs(int outputs) { context_.set_outputs(outputs); }
+        void set_max_faces(int max_faces, faceRank rank = RankByScore) {
+            context_.set_max_faces(max_faces, rank);
+        }
+        // Also sizes the plans of every level up front.
+        void set_deadline(float deadline_ms, const std::vector<QualityLevel>& levels);
+
         std::vector<bbox> predict(const cv::Mat& im);
-        ~DetectNet();
-//        float getDetectTime();
-//        float getLandmarkTime();
-//        float detect_time,landmark_time;
+        std::vector<bbox> predict(const ImageView& im);
+        // NV21 / NV12 frame: full-resolution Y plane and interleaved chroma plane.
+        std::vector<bbox> predict(const unsigned char* y, int y_stride,
+                                  const unsigned char* uv, int uv_stride,
+                                  int width, int height, pixelFormat format);
+        // I420 frame: separate Y, U and V planes.
+        std::vector<bbox> predict(const unsigned char* y, int y_stride,
+                                  const unsigned char* u, int u_stride,
+                                  const unsigned char* v, int v_stride,
+                                  int width, int height);
+        std::vector<bbox> predict(const cv::Mat& im, InferenceContext& ctx) const;
+        std::vector<bbox> predict(const ImageView& im, InferenceContext& ctx) const;
+        // Photo batches: the frames go through the detector as one
+        // (N, 3, H, W) input and all their faces through one LandmarkNet
+        // pass; faces[i] belongs to ims[i]. Stats cover the whole batch.
+        // Tracking is neither used nor updated.
+        std::vector<std::vector<bbox> > predict(const std::vector<cv::Mat>& ims);
+        std::vector<std::vector<bbox> > predict(const std::vector<cv::Mat>& ims,
+                                                InferenceContext& ctx) const;
 
     protected:
-        pthreadpool_t threadpool_;
-        LandmarkNet*  landmarknet_;
-        std::vector<Blob*> param_;
-        std::vector<Blob*> blobs_;
+        DetectPlan* get_plan(InferenceContext& ctx, int width, int height, int batch = 1) const;
+        // ctx, when given, only receives profiling and trace records; ops,
+        // when given, receives the per-op record instead of ctx
+        void forward(const Blob* input, DetectPlan* plan, threadpool_t threadpool,
+                     InferenceContext* ctx = NULL, std::vector<LayerStats>* ops = NULL) const;
+        void fill_input(const cv::Mat& im, Blob* input, const InputLayout& layout,
+                        threadpool_t threadpool) const;
+        void fill_input(const ImageView& im, Blob* input, const InputLayout& layout,
+                        threadpool_t threadpool) const;
+        // boxes of the given image of a batched plan; NMS keeps at most
+        // max_keep boxes when positive and counts the rest in *dropped
+        std::vector<bbox> decode(const DetectPlan* plan, const InputLayout& layout,
+                                 int im_width, int im_height, int image = 0,
+                                 int max_keep = 0, int* dropped = NULL) const;
+        template <typename Image>
+        std::vector<bbox> detect(const Image& im, int im_width, int im_height,
+                                 InferenceContext& ctx) const;
+        template <typename Image>
+        std::vector<bbox> run(const Image& im, int im_width, int im_height,
+                              InferenceContext& ctx) const;
+
+        std::shared_ptr<Model> owned_model_;
+        std::shared_ptr<const Model> model_;
+        LandmarkNet landmarknet_;
+        InferenceContext context_;
     };
 
 } //namespace  galaxy
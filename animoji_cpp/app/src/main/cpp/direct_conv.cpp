@@ -0,0 +1,164 @@
+#include <string.h>
+#include <algorithm>
+#include "direct_conv.hpp"
+#include "math_functions.hpp"
+#include "simd.hpp"
+
+namespace  galaxy {
+    // input is the padded image
+    struct direct_context {
+        const float* input;
+        int height, width;
+        const float* b;
+        float* output;
+        int out_height, out_width;
+        bool relu;
+    };
+
+    // Every channel count and the stride are template arguments, so the
+    // tap loops have constant trip counts and offsets. A block holds 4
+    // output channels x 8 output pixels in registers; the weights come
+    // pre-broadcast, one vector per weight, so each tap is plain loads and
+    // multiply-adds.
+    template <int CIN, int COUT, int STRIDE>
+    struct DirectConv3x3 {
+        static const int kTaps = CIN*9;
+
+        static v4f load_pixels(const float* p) {
+            if (STRIDE == 1) return v4f_load(p);
+            float t[4] = {p[0], p[STRIDE], p[2*STRIDE], p[3*STRIDE]};
+            return v4f_load(t);
+        }
+
+        static v4f activate(const direct_context* ctx, v4f a) {
+            return ctx->relu ? v4f_max(a, v4f_set1(0.0f)) : a;
+        }
+
+        // cols < 8 only for the last block of a row
+        static void block8(const direct_context* ctx, const float* wb, int oy, int ox, int cols) {
+            const int plane = ctx->height*ctx->width;
+            const int out_plane = ctx->out_height*ctx->out_width;
+            const float* in = ctx->input + oy*STRIDE*ctx->width + ox*STRIDE;
+            float* out = ctx->output + oy*ctx->out_width + ox;
+            float tail[4*8];
+            for (int g = 0; g < COUT; g += 4) {
+                v4f a00 = v4f_set1(ctx->b[g]), a01 = a00;
+                v4f a10 = v4f_set1(ctx->b[g + 1]), a11 = a10;
+                v4f a20 = v4f_set1(ctx->b[g + 2]), a21 = a20;
+                v4f a30 = v4f_set1(ctx->b[g + 3]), a31 = a30;
+                const float* wk = wb + g*kTaps*4;
+                for (int ci = 0; ci < CIN; ++ci) {
+                    for (int ky = 0; ky < 3; ++ky) {
+                        const float* row = in + ci*plane + ky*ctx->width;
+                        for (int kx = 0; kx < 3; ++kx, wk += 16) {
+                            const v4f x0 = load_pixels(row + kx);
+                            const v4f x1 = load_pixels(row + kx + 4*STRIDE);
+                            v4f w = v4f_load(wk);
+                            a00 = v4f_fmadd(w, x0, a00);
+                            a01 = v4f_fmadd(w, x1, a01);
+                            w = v4f_load(wk + 4);
+                            a10 = v4f_fmadd(w, x0, a10);
+                            a11 = v4f_fmadd(w, x1, a11);
+                            w = v4f_load(wk + 8);
+                            a20 = v4f_fmadd(w, x0, a20);
+                            a21 = v4f_fmadd(w, x1, a21);
+                            w = v4f_load(wk + 12);
+                            a30 = v4f_fmadd(w, x0, a30);
+                            a31 = v4f_fmadd(w, x1, a31);
+                        }
+                    }
+                }
+                float* o = cols == 8 ? out + g*out_plane : tail;
+                const int stride = cols == 8 ? out_plane : 8;
+                v4f_store(o, activate(ctx, a00));
+                v4f_store(o + 4, activate(ctx, a01));
+                v4f_store(o + stride, activate(ctx, a10));
+                v4f_store(o + stride + 4, activate(ctx, a11));
+                v4f_store(o + 2*stride, activate(ctx, a20));
+                v4f_store(o + 2*stride + 4, activate(ctx, a21));
+                v4f_store(o + 3*stride, activate(ctx, a30));
+                v4f_store(o + 3*stride + 4, activate(ctx, a31));
+                if (cols == 8) continue;
+                for (int l = 0; l < 4; ++l) {
+                    for (int x = 0; x < cols; ++x) out[(g + l)*out_plane + x] = tail[l*8 + x];
+                }
+            }
+        }
+
+        struct context {
+            direct_context conv;
+            // per group of 4 filters and tap, the 4 weights broadcast
+            float wb[COUT*kTaps*4];
+        };
+
+        static void row(void* argument, size_t y) {
+            const context* c = static_cast<const context*>(argument);
+            const int out_width = c->conv.out_width;
+            for (int ox = 0; ox < out_width; ox += 8) {
+                block8(&c->conv, c->wb, static_cast<int>(y), ox, (std::min)(8, out_width - ox));
+            }
+        }
+
+        static void run(const float* input, int height, int width,
+                        const float* w, const float* b, float* output,
+                        int pad_top, int pad_left, int pad_bottom,
+                        int pad_right, bool relu, threadpool_t threadpool) {
+            const int out_height = (height + pad_top + pad_bottom - 3)/STRIDE + 1;
+            const int out_width = (width + pad_left + pad_right - 3)/STRIDE + 1;
+            // zero-padded copy of the image, wide enough for whole blocks,
+            // so every pixel takes the vector path
+            const int padded_height = (out_height - 1)*STRIDE + 3;
+            const int padded_width = ((out_width + 7)/8*8 - 1)*STRIDE + 3;
+            const int plane = padded_height*padded_width;
+            static thread_local Workspace padded;
+            padded.reserve(size_t(CIN*plane)*sizeof(float));
+            float* p = static_cast<float*>(padded.data);
+            memset(p, 0, size_t(CIN*plane)*sizeof(float));
+            const int rows = (std::min)(height, padded_height - pad_top);
+            const int cols = (std::min)(width, padded_width - pad_left);
+            for (int ci = 0; ci < CIN; ++ci) {
+                for (int y = 0; y < rows; ++y) {
+                    memcpy(p + ci*plane + (y + pad_top)*padded_width + pad_left,
+                           input + (ci*height + y)*width, size_t(cols)*sizeof(float));
+                }
+            }
+
+            context c = {{p, padded_height, padded_width, b, output, out_height, out_width,
+                          relu}, {}};
+            float* dst = c.wb;
+            for (int g = 0; g < COUT; g += 4) {
+                for (int t = 0; t < kTaps; ++t) {
+                    for (int l = 0; l < 4; ++l, dst += 4) {
+                        dst[0] = dst[1] = dst[2] = dst[3] = w[(g + l)*kTaps + t];
+                    }
+                }
+            }
+            threadpool_compute_1d(threadpool, row, &c, size_t(out_height));
+        }
+    };
+
+    struct direct_kernel {
+        int channels;
+        int filters;
+        int stride;
+        direct_conv3x3_fn run;
+    };
+
+    // Layers where the direct kernel timed faster than the native GEMM in
+    // op_benchmark (its conv_forward and backend rows); from 16 input
+    // channels on the GEMM wins. filters must be a multiple of 4.
+    static const direct_kernel kDirectKernels[] = {
+        {3, 8, 1, DirectConv3x3<3, 8, 1>::run},
+        {8, 12, 1, DirectConv3x3<8, 12, 1>::run},
+        {12, 16, 1, DirectConv3x3<12, 16, 1>::run},
+        {8, 16, 1, DirectConv3x3<8, 16, 1>::run},
+    };
+
+    direct_conv3x3_fn find_direct_conv3x3(int channels, int filters, int stride) {
+        for (size_t i = 0; i < sizeof(kDirectKernels)/sizeof(kDirectKernels[0]); ++i) {
+            const direct_kernel& k = kDirectKernels[i];
+            if (k.channels == channels && k.filters == filters && k.stride == stride) return k.run;
+        }
+        return NULL;
+    }
+} //namespace  galaxy
@@ -0,0 +1,21 @@
+#ifndef DIRECT_CONV_HPP_
+#define DIRECT_CONV_HPP_
+
+#include "threadpool.hpp"
+
+namespace  galaxy {
+    // One image of a 3x3 convolution of input (channels, height, width)
+    // zero-padded by the given rows and columns on each side; output is
+    // (filters, (height + pad_top + pad_bottom - 3)/stride + 1, ...).
+    typedef void (*direct_conv3x3_fn)(const float* input, int height, int width,
+                                      const float* w, const float* b, float* output,
+                                      int pad_top, int pad_left, int pad_bottom,
+                                      int pad_right, bool relu, threadpool_t threadpool);
+
+    // Direct 3x3 kernels compiled for the few-channel layers at the start
+    // of DetectNet, where transform and GEMM kernels move more data than
+    // they compute. NULL for layers without one. conv_forward only uses
+    // them under the native backend, the one they were measured against.
+    direct_conv3x3_fn find_direct_conv3x3(int channels, int filters, int stride);
+} //namespace  galaxy
+#endif //DIRECT_CONV_HPP_
@@ -10,6 +10,7 @@
 
 using namespace galaxy;
 using namespace std::chrono;
+float detect_time,landmark_time;
 
 float face_prediction() {
 
@@ -52,6 +53,8 @@ float face_prediction() {
 //    std::cout << dt  << ", " << avg_dt << std::endl;
 
     std::vector<bbox> boxes = detect.predict(im);
+    detect_time = detect.context().stats().detect_time;
+    landmark_time = detect.context().stats().landmark_time;
     for (size_t i = 0; i < boxes.size(); ++i) {
         cv::Scalar color=cv::Scalar(0,255,0);
         float* landmark = boxes[i].array() + 10;
@@ -0,0 +1,121 @@
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "detection.hpp"
+#include "galaxy_api.h"
+
+using namespace galaxy;
+
+struct galaxy_detector {
+    explicit galaxy_detector(std::shared_ptr<const Model> model, const galaxy_options& options)
+        :net(model, options.num_threads) {
+        net.set_input_size(options.input_width, options.input_height,
+                           options.letterbox ? Letterbox : Stretch);
+        net.set_tracking(options.keyframe_interval);
+    }
+
+    DetectNet net;
+};
+
+static bool valid_options(const galaxy_options& options) {
+    return options.input_width > 0 && options.input_width % 16 == 0
+           && options.input_height > 0 && options.input_height % 16 == 0;
+}
+
+static galaxy_detector* create(std::shared_ptr<const Model> model, const galaxy_options* options) {
+    galaxy_options defaults;
+    galaxy_default_options(&defaults);
+    if (!options) options = &defaults;
+    if (!model || !valid_options(*options)) return NULL;
+    return new galaxy_detector(model, *options);
+}
+
+extern "C" {
+void galaxy_default_options(galaxy_options* options) {
+    options->num_threads = 0;
+    options->input_width = 112;
+    options->input_height = 112;
+    options->letterbox = 0;
+    options->keyframe_interval = 0;
+}
+
+galaxy_detector* galaxy_create(const char* model_path, const galaxy_options* options) {
+    if (!model_path) return NULL;
+    if (Model::is_snapshot(model_path)) return create(Model::load_snapshot(model_path), options);
+    std::ifstream infile(model_path, std::ifstream::binary | std::ifstream::ate);
+    if (!infile.is_open()) return NULL;
+    std::vector<char> data(static_cast<size_t>(infile.tellg()));
+    infile.seekg(0);
+    if (!data.empty()) infile.read(&data[0], data.size());
+    if (!infile || data.empty()) return NULL;
+    return galaxy_create_from_memory(&data[0], data.size(), options);
+}
+
+galaxy_detector* galaxy_create_from_memory(const void* data, size_t size,
+                                           const galaxy_options* options) {
+    if (!data) return NULL;
+    if (Model::is_snapshot(data, size)) return create(Model::load_snapshot(data, size), options);
+    std::shared_ptr<Model> model(new Model);
+    if (!model->load_weight(data, size)) return NULL;
+    return create(model, options);
+}
+
+int galaxy_predict(galaxy_detector* detector, const unsigned char* image,
+                   int width, int height, int stride, galaxy_pixel_format format,
+                   galaxy_face* faces, int max_faces) {
+    if (!detector || !image || width <= 0 || height <= 0 || max_faces < 0
+        || (max_faces > 0 && !faces))
+        return -1;
+    ImageView view;
+    view.width = width;
+    view.height = height;
+    const unsigned char* chroma = image + stride*height;
+    switch (format) {
+    case GALAXY_FORMAT_BGR:
+        if (stride < 3*width) return -1;
+        view.format = BGR;
+        view.plane[0] = image;
+        view.plane[1] = view.plane[2] = NULL;
+        view.stride[0] = stride;
+        view.stride[1] = view.stride[2] = 0;
+        break;
+    case GALAXY_FORMAT_NV21:
+    case GALAXY_FORMAT_NV12:
+        if (stride < width) return -1;
+        view = make_view(image, stride, chroma, stride, width, height,
+                         format == GALAXY_FORMAT_NV21 ? NV21 : NV12);
+        break;
+    case GALAXY_FORMAT_I420:
+        if (stride < width) return -1;
+        view = make_view(image, stride, chroma, stride/2,
+                         chroma + (stride/2)*((height + 1)/2), stride/2, width, height);
+        break;
+    default:
+        return -1;
+    }
+
+    std::vector<bbox> boxes = detector->net.predict(view);
+    std::sort(boxes.begin(), boxes.end(),
+              [](const bbox& a, const bbox& b) { return a.score > b.score; });
+    int n = (std::min)(max_faces, static_cast<int>(boxes.size()));
+    for (int i = 0; i < n; ++i) {
+        galaxy_face& face = faces[i];
+        face.x1 = static_cast<float>(boxes[i].x1);
+        face.y1 = static_cast<float>(boxes[i].y1);
+        face.x2 = static_cast<float>(boxes[i].x2);
+        face.y2 = static_cast<float>(boxes[i].y2);
+        face.score = boxes[i].score;
+        if (boxes[i].array())
+            memcpy(face.points, boxes[i].array(), sizeof(face.points));
+        else
+            memset(face.points, 0, sizeof(face.points));
+    }
+    return static_cast<int>(boxes.size());
+}
+
+void galaxy_destroy(galaxy_detector* detector) {
+    delete detector;
+}
+} // extern "C"
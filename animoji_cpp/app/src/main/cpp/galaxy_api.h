@@ -0,0 +1,74 @@
+#ifndef GALAXY_API_H_
+#define GALAXY_API_H_
+
+#include <stddef.h>
+
+/*
+ * Stable C interface for embedders (JNI, host services). A detector is
+ * created once, kept warm for the lifetime of the caller and fed frames;
+ * results are written into caller-owned arrays. A detector must not be
+ * used by two threads at once; create one per thread.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GALAXY_API_VERSION 1
+/* 5 facial landmarks followed by 70 animoji points */
+#define GALAXY_NUM_POINTS 75
+
+typedef struct galaxy_detector galaxy_detector;
+
+typedef enum {
+    GALAXY_FORMAT_BGR = 0,
+    GALAXY_FORMAT_NV21 = 1,
+    GALAXY_FORMAT_NV12 = 2,
+    GALAXY_FORMAT_I420 = 3
+} galaxy_pixel_format;
+
+typedef struct {
+    int num_threads;        /* <= 0: one per core */
+    int input_width;        /* detector input, multiple of 16 */
+    int input_height;
+    int letterbox;          /* keep the aspect ratio, pad the rest */
+    int keyframe_interval;  /* video tracking; <= 1 disables it */
+} galaxy_options;
+
+typedef struct {
+    float x1, y1, x2, y2;
+    float score;
+    float points[2*GALAXY_NUM_POINTS];  /* x, y pairs in image pixels */
+} galaxy_face;
+
+/* num_threads 0, 112x112 stretched input, no tracking */
+void galaxy_default_options(galaxy_options* options);
+
+/*
+ * model_path and data hold either the raw .bin weights or a snapshot.
+ * options may be NULL for the defaults. Returns NULL when the model cannot
+ * be read. data may be freed once galaxy_create_from_memory returns.
+ */
+galaxy_detector* galaxy_create(const char* model_path, const galaxy_options* options);
+galaxy_detector* galaxy_create_from_memory(const void* data, size_t size,
+                                           const galaxy_options* options);
+
+/*
+ * image is the first byte of the frame, stride the bytes per row of its
+ * first plane. For the YUV formats the planes follow each other without
+ * gaps: chroma starts at image + stride*height, and for I420 the V plane
+ * follows the U plane, whose stride is stride/2.
+ *
+ * Writes up to max_faces faces, highest score first, and returns the
+ * number of faces found, which may be larger than max_faces; negative on
+ * invalid arguments.
+ */
+int galaxy_predict(galaxy_detector* detector, const unsigned char* image,
+                   int width, int height, int stride, galaxy_pixel_format format,
+                   galaxy_face* faces, int max_faces);
+
+void galaxy_destroy(galaxy_detector* detector);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* GALAXY_API_H_ */
@@ -0,0 +1,165 @@
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "image_utils.hpp"
+
+namespace  galaxy {
+    ImageView make_view(const cv::Mat& im) {
+        assert(im.type() == CV_8UC3);
+        ImageView view;
+        view.format = BGR;
+        view.width = im.cols;
+        view.height = im.rows;
+        view.plane[0] = im.data;
+        view.plane[1] = view.plane[2] = NULL;
+        view.stride[0] = static_cast<int>(im.step);
+        view.stride[1] = view.stride[2] = 0;
+        return view;
+    }
+
+    ImageView make_view(const unsigned char* y, int y_stride,
+                        const unsigned char* uv, int uv_stride,
+                        int width, int height, pixelFormat format) {
+        assert(format == NV21 || format == NV12);
+        ImageView view;
+        view.format = format;
+        view.width = width;
+        view.height = height;
+        view.plane[0] = y;
+        view.plane[1] = format == NV12 ? uv : uv + 1;
+        view.plane[2] = format == NV12 ? uv + 1 : uv;
+        view.stride[0] = y_stride;
+        view.stride[1] = view.stride[2] = uv_stride;
+        return view;
+    }
+
+    ImageView make_view(const unsigned char* y, int y_stride,
+                        const unsigned char* u, int u_stride,
+                        const unsigned char* v, int v_stride,
+                        int width, int height) {
+        ImageView view;
+        view.format = I420;
+        view.width = width;
+        view.height = height;
+        view.plane[0] = y;
+        view.plane[1] = u;
+        view.plane[2] = v;
+        view.stride[0] = y_stride;
+        view.stride[1] = u_stride;
+        view.stride[2] = v_stride;
+        return view;
+    }
+
+    struct resize_context {
+        const ImageView* im;
+        int x, y, w, h;
+        const int* xofs;
+        const float* xalpha;
+        const int* yofs;
+        const float* yalpha;
+        float* out;
+        int out_w, out_h;
+        int out_stride, plane_stride;
+        bool rgb;
+        float alpha, beta;
+    };
+
+    inline float clamp_u8(float v) {
+        return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+    }
+
+    // BT.601 video range, same coefficients as cv::COLOR_YUV2BGR_NV21.
+    inline void fetch_bgr(const ImageView& im, int col, int row, float* bgr) {
+        if (col < 0 || row < 0 || col >= im.width || row >= im.height) {
+            bgr[0] = bgr[1] = bgr[2] = 0.0f;
+            return;
+        }
+        if (im.format == BGR) {
+            const unsigned char* p = im.plane[0] + row*im.stride[0] + 3*col;
+            bgr[0] = p[0];
+            bgr[1] = p[1];
+            bgr[2] = p[2];
+            return;
+        }
+        int c = im.format == I420 ? (col >> 1) : (col >> 1) << 1;
+        float yy = 1.164f*((int)im.plane[0][row*im.stride[0] + col] - 16);
+        float u = (int)im.plane[1][(row >> 1)*im.stride[1] + c] - 128.0f;
+        float v = (int)im.plane[2][(row >> 1)*im.stride[2] + c] - 128.0f;
+        bgr[0] = clamp_u8(yy + 2.018f*u);
+        bgr[1] = clamp_u8(yy - 0.813f*v - 0.391f*u);
+        bgr[2] = clamp_u8(yy + 1.596f*v);
+    }
+
+    static void resize_row(void* argument, size_t dy) {
+        const resize_context* ctx = static_cast<const resize_context*>(argument);
+        const ImageView& im = *ctx->im;
+        int sy = ctx->yofs[dy];
+        float ay = ctx->yalpha[dy];
+        int row0 = ctx->y + sy;
+        int row1 = ctx->y + (std::min)(sy + 1, ctx->h - 1);
+        float* out = ctx->out + dy*ctx->out_stride;
+        float p00[3], p01[3], p10[3], p11[3];
+        for (int dx = 0; dx < ctx->out_w; ++dx) {
+            int sx = ctx->xofs[dx];
+            float ax = ctx->xalpha[dx];
+            int col0 = ctx->x + sx;
+            int col1 = ctx->x + (std::min)(sx + 1, ctx->w - 1);
+            fetch_bgr(im, col0, row0, p00);
+            fetch_bgr(im, col1, row0, p01);
+            fetch_bgr(im, col0, row1, p10);
+            fetch_bgr(im, col1, row1, p11);
+            for (int c = 0; c < 3; ++c) {
+                float top = p00[c] + ax*(p01[c] - p00[c]);
+                float bottom = p10[c] + ax*(p11[c] - p10[c]);
+                int plane = ctx->rgb ? 2 - c : c;
+                out[plane*ctx->plane_stride + dx] = (top + ay*(bottom - top))*ctx->alpha + ctx->beta;
+            }
+        }
+    }
+
+    // Source offsets and weights in the cv::resize INTER_LINEAR convention.
+    static void linear_coeffs(int src, int dst, int* ofs, float* alpha) {
+        float scale = static_cast<float>(src)/dst;
+        for (int d = 0; d < dst; ++d) {
+            float f = (d + 0.5f)*scale - 0.5f;
+            int s = static_cast<int>(floorf(f));
+            f -= s;
+            if (s < 0) { s = 0; f = 0.0f; }
+            if (s >= src - 1) { s = src - 1; f = 0.0f; }
+            ofs[d] = s;
+            alpha[d] = f;
+        }
+    }
+
+    void crop_resize_normalize(const ImageView& im, int x, int y, int w, int h,
+                               float* out, int out_w, int out_h,
+                               int out_stride, int plane_stride, bool rgb,
+                               float alpha, float beta, threadpool_t threadpool) {
+        assert(w > 0 && h > 0);
+        std::vector<int> xofs(out_w), yofs(out_h);
+        std::vector<float> xalpha(out_w), yalpha(out_h);
+        linear_coeffs(w, out_w, &xofs[0], &xalpha[0]);
+        linear_coeffs(h, out_h, &yofs[0], &yalpha[0]);
+
+        resize_context ctx;
+        ctx.im = &im;
+        ctx.x = x;
+        ctx.y = y;
+        ctx.w = w;
+        ctx.h = h;
+        ctx.xofs = &xofs[0];
+        ctx.xalpha = &xalpha[0];
+        ctx.yofs = &yofs[0];
+        ctx.yalpha = &yalpha[0];
+        ctx.out = out;
+        ctx.out_w = out_w;
+        ctx.out_h = out_h;
+        ctx.out_stride = out_stride;
+        ctx.plane_stride = plane_stride;
+        ctx.rgb = rgb;
+        ctx.alpha = alpha;
+        ctx.beta = beta;
+        threadpool_compute_1d(threadpool, resize_row, &ctx, size_t(out_h));
+    }
+} //namespace  galaxy
@@ -0,0 +1,41 @@
+#ifndef IMAGE_UTILS_HPP_
+#define IMAGE_UTILS_HPP_
+
+#include <opencv2/opencv.hpp>
+#include "threadpool.hpp"
+
+namespace  galaxy {
+    enum pixelFormat {BGR, NV21, NV12, I420};
+
+    // Non-owning view of an 8-bit frame. For BGR only plane[0] is used.
+    // For YUV 4:2:0, plane[1]/plane[2] point at the first U/V sample; the
+    // semi-planar formats (NV21, NV12) share one interleaved plane.
+    struct ImageView {
+        pixelFormat format;
+        int width;
+        int height;
+        const unsigned char* plane[3];
+        int stride[3];
+    };
+
+    ImageView make_view(const cv::Mat& im);
+    ImageView make_view(const unsigned char* y, int y_stride,
+                        const unsigned char* uv, int uv_stride,
+                        int width, int height, pixelFormat format);
+    ImageView make_view(const unsigned char* y, int y_stride,
+                        const unsigned char* u, int u_stride,
+                        const unsigned char* v, int v_stride,
+                        int width, int height);
+
+    // Bilinearly resamples the region (x, y, w, h) of im to out_w x out_h and
+    // writes it as three planar float channels, out = pixel*alpha + beta.
+    // Rows of a channel are out_stride floats apart, channels plane_stride.
+    // Color conversion happens only at the sampled positions; pixels of the
+    // region outside the image are black, as with cv::copyMakeBorder.
+    void crop_resize_normalize(const ImageView& im, int x, int y, int w, int h,
+                               float* out, int out_w, int out_h,
+                               int out_stride, int plane_stride, bool rgb,
+                               float alpha, float beta,
+                               threadpool_t threadpool = NULL);
+} //namespace  galaxy
+#endif //IMAGE_UTILS_HPP_
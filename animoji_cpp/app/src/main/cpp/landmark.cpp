@@ -1,10 +1,14 @@
 #include <assert.h>
+#include <string.h>
 #include <algorithm>
 #include <memory>
 #include "landmark.hpp"
 #include "math_functions.hpp"
 
 namespace galaxy {
+    // classifier score a box needs to be kept
+    static const float kAcceptThreshold = 0.7f;
+
     inline void _convert_to_square(std::vector<bbox>& boxes, float expand=0.0f){
         for (size_t i = 0; i < boxes.size(); ++i) {
             int w = boxes[i].x2 - boxes[i].x1 + 1;
@@ -41,109 +45,155 @@ namespace galaxy {
         }
     }
 
-    LandmarkNet::LandmarkNet(pthreadpool_t threadpool)
-        :threadpool_(threadpool){
-        build_net();
+    LandmarkNet::LandmarkNet(const Model* model)
+        :model_(model){
     }
 
-
-    void LandmarkNet::load_weight(std::ifstream& infile) {
-        for (size_t i = 0; i < param_.size(); ++i) {
-            infile.read((char*)param_[i]->data(), param_[i]->count()*sizeof(float));
-            assert(infile.gcount() == param_[i]->count()*sizeof(float));
+    // Schedules are per batch size, and only while the landmark stage runs
+    // on the detector's pool; a dedicated landmark pool is used as is.
+    void LandmarkNet::forward(const Blob* input, InferenceContext& ctx) const {
+        TraceScope trace(ctx.tracer_, "forward", "landmark");
+        threadpool_t threadpool = ctx.landmark_threadpool();
+        if (ctx.thread_policy_ == UniformThreads || threadpool != ctx.threadpool()) {
+            forward(input, ctx, OpThreads(threadpool, NULL), ctx.landmark_layers());
+            return;
         }
+        int batch = input->shape(0);
+        std::map<int, std::vector<threadpool_t> >::iterator it = ctx.landmark_schedules_.find(batch);
+        if (it == ctx.landmark_schedules_.end()) {
+            std::vector<int> threads;
+            if (ctx.thread_policy_ == CalibratedThreads) {
+                threads = calibrate_threads(thread_candidates(ctx.detect_threads()), 5,
+                        [&](int n, std::vector<LayerStats>* ops) {
+                            forward(input, ctx, OpThreads(ctx.pool_for(n), NULL), ops);
+                        });
+            } else {
+                std::vector<LayerStats> ops;
+                forward(input, ctx, OpThreads(threadpool, NULL), &ops);
+                threads = cost_model_threads(ops, ctx.detect_threads(), ctx.inline_small_);
+            }
+            it = ctx.landmark_schedules_.insert(std::make_pair(batch, ctx.resolve(threads))).first;
+        }
+        forward(input, ctx, OpThreads(threadpool, &it->second), ctx.landmark_layers());
     }
 
-    void LandmarkNet::build_net(){
-        param_.reserve(23);
-        param_.push_back(new Blob(32, 3, 3, 3));
-        param_.push_back(new Blob(32));
-        param_.push_back(new Blob(32));
-
-        param_.push_back(new Blob(64, 32, 3, 3));
-        param_.push_back(new Blob(64));
-        param_.push_back(new Blob(64));
-
-        param_.push_back(new Blob(64, 64, 3, 3));
-        param_.push_back(new Blob(64));
-        param_.push_back(new Blob(64));
-
-        param_.push_back(new Blob(128, 64, 2, 2));
-        param_.push_back(new Blob(128));
-        param_.push_back(new Blob(128));
-
-        param_.push_back(new Blob(256, 128*3*3));
-        param_.push_back(new Blob(256));
-        param_.push_back(new Blob(256));
-
-        param_.push_back(new Blob(2, 256));
-        param_.push_back(new Blob(2));
-
-        param_.push_back(new Blob(4, 256));
-        param_.push_back(new Blob(4));
-
-        param_.push_back(new Blob(10, 256));
-        param_.push_back(new Blob(10));
-
-        param_.push_back(new Blob(140, 256));
-        param_.push_back(new Blob(140));
+    // Copies the trunk rows of the boxes the classifier accepts to accepted,
+    // in order, and returns their number; accepted is left alone when that
+    // is none or all of them.
+    static int compact_accepted(const Blob* cls, const Blob* trunk, Blob*& accepted) {
+        int nbox = cls->shape(0);
+        const float* scores = cls->data();
+        int n = 0;
+        for (int k = 0; k < nbox; ++k) {
+            if (scores[2 * k + 1] > kAcceptThreshold) n++;
+        }
+        if (n == 0 || n == nbox) return n;
 
-        blobs_.resize(13);
-    #ifdef _DEBUG
-        for (int i = 0; i < 13; ++i)
-            assert(!blobs_[i]);
-    #endif
+        int dim = trunk->count()/nbox;
+        if (accepted) accepted->reshape({n, dim});
+        else accepted = new Blob(n, dim);
+        float* dst = accepted->data();
+        for (int k = 0; k < nbox; ++k) {
+            if (scores[2 * k + 1] > kAcceptThreshold) {
+                memcpy(dst, trunk->data() + k*dim, dim*sizeof(float));
+                dst += dim;
+            }
+        }
+        return n;
     }
 
-    void LandmarkNet::forward(const Blob* input) {
-        /*
-
-          void conv_forward(const Blob* input, Blob*& output, const Blob* w,
-                      const Blob* b, pthreadpool_t threadpool, int pad0,
-                      int pad1, int stride, bool activation){}
-
-        */
-        conv_forward(input, blobs_[0], param_[0], param_[1], threadpool_);
-
-        cnn_maxpooling(blobs_[0], blobs_[1], 3, 2, threadpool_, Same);
-        prelu(blobs_[1], param_[2]);
-
-        conv_forward(blobs_[1], blobs_[2], param_[3], param_[4], threadpool_);
-        cnn_maxpooling(blobs_[2], blobs_[3], 3, 2, threadpool_, Valid);
-        prelu(blobs_[3], param_[5]);
-
-        conv_forward(blobs_[3], blobs_[4], param_[6], param_[7], threadpool_);
-        cnn_maxpooling(blobs_[4], blobs_[5], 2, 2, threadpool_, Same);
-        prelu(blobs_[5], param_[8]);
-
-        conv_forward(blobs_[5], blobs_[6], param_[9], param_[10], threadpool_);
-        prelu(blobs_[6], param_[11]);
-
-        fully_connected(blobs_[6], blobs_[7], param_[12], param_[13], threadpool_);
-        prelu(blobs_[7], param_[14]);
-
-        fully_connected(blobs_[7], blobs_[8], param_[15], param_[16], threadpool_);
-        softmax(blobs_[8], threadpool_);
-
-        fully_connected(blobs_[7], blobs_[9], param_[17], param_[18], threadpool_);
-
-        fully_connected(blobs_[7], blobs_[10], param_[19], param_[20], threadpool_);
+    void LandmarkNet::forward(const Blob* input, InferenceContext& ctx, OpThreads threads,
+                              std::vector<LayerStats>* layers) const {
+        const std::vector<Blob*>& param = model_->landmark_param();
+        const std::vector<Blob*>& transform = model_->landmark_transform();
+        const std::vector<SparseWeights*>& sparse = model_->landmark_sparse();
+        std::vector<Blob*>& blobs = ctx.landmark_blobs_;
+        LayerProfiler prof(layers, ctx.tracer_, "landmark",
+                           ctx.capture_ && layers == ctx.landmark_layers());
+        conv_forward(input, blobs[0], param[0], param[1], threads.next(),
+                     0, 0, 1, false, NULL, transform[0], prof.nnpack(), sparse[0]);
+        prof.record("conv", input, blobs[0]);
+
+        cnn_maxpooling(blobs[0], blobs[1], 3, 2, threads.next(), Same);
+        prof.record("maxpool", blobs[0], blobs[1]);
+        prelu(blobs[1], param[2]);
+        prof.record("prelu", blobs[1], blobs[1]);
+
+        conv_forward(blobs[1], blobs[2], param[3], param[4], threads.next(),
+                     0, 0, 1, false, NULL, transform[3], prof.nnpack(), sparse[3]);
+        prof.record("conv", blobs[1], blobs[2]);
+        cnn_maxpooling(blobs[2], blobs[3], 3, 2, threads.next(), Valid);
+        prof.record("maxpool", blobs[2], blobs[3]);
+        prelu(blobs[3], param[5]);
+        prof.record("prelu", blobs[3], blobs[3]);
+
+        conv_forward(blobs[3], blobs[4], param[6], param[7], threads.next(),
+                     0, 0, 1, false, NULL, transform[6], prof.nnpack(), sparse[6]);
+        prof.record("conv", blobs[3], blobs[4]);
+        cnn_maxpooling(blobs[4], blobs[5], 2, 2, threads.next(), Same);
+        prof.record("maxpool", blobs[4], blobs[5]);
+        prelu(blobs[5], param[8]);
+        prof.record("prelu", blobs[5], blobs[5]);
+
+        conv_forward(blobs[5], blobs[6], param[9], param[10], threads.next(),
+                     0, 0, 1, false, NULL, transform[9], prof.nnpack(), sparse[9]);
+        prof.record("conv", blobs[5], blobs[6]);
+        prelu(blobs[6], param[11]);
+        prof.record("prelu", blobs[6], blobs[6]);
+
+        fully_connected(blobs[6], blobs[7], param[12], param[13], threads.next(),
+                        prof.nnpack(), sparse[12]);
+        prof.record("fc", blobs[6], blobs[7]);
+        prelu(blobs[7], param[14]);
+        prof.record("prelu", blobs[7], blobs[7]);
+
+        fully_connected(blobs[7], blobs[8], param[15], param[16], threads.next(),
+                        prof.nnpack(), sparse[15]);
+        prof.record("fc", blobs[7], blobs[8]);
+        softmax(blobs[8], threads.next());
+        prof.record("softmax", blobs[8], blobs[8]);
+
+        const Blob* trunk = blobs[7];
+        if (ctx.landmark_cascade_) {
+            int accepted = compact_accepted(blobs[8], blobs[7], blobs[12]);
+            if (accepted == 0) return;
+            if (accepted < blobs[7]->shape(0)) {
+                trunk = blobs[12];
+                prof.record("compact", blobs[7], blobs[12]);
+            }
+        }
 
-        fully_connected(blobs_[7], blobs_[11], param_[21], param_[22], threadpool_);
+        const int outputs = ctx.landmark_outputs();
+        if (outputs & OutputBox) {
+            fully_connected(trunk, blobs[9], param[17], param[18], threads.next(),
+                            prof.nnpack(), sparse[17]);
+            prof.record("fc", trunk, blobs[9]);
+        }
+        if (outputs & OutputLandmarks) {
+            fully_connected(trunk, blobs[10], param[19], param[20], threads.next(),
+                            prof.nnpack(), sparse[19]);
+            prof.record("fc", trunk, blobs[10]);
+        }
+        if (outputs & OutputAnimoji) {
+            fully_connected(trunk, blobs[11], param[21], param[22], threads.next(),
+                            prof.nnpack(), sparse[21]);
+            prof.record("fc", trunk, blobs[11]);
+        }
     }
 
-    void LandmarkNet::predict(const cv::Mat& im, std::vector<bbox>& boxes) {
-        const float threshold = 0.7;
-        const int net_size = 48;
+    static const int kNetSize = 48;
+
+    // boxes are already square; each crop takes 3*48*48 floats of input_data
+    void LandmarkNet::crop(const cv::Mat& im, const std::vector<bbox>& boxes, float* input_data,
+                           InferenceContext& ctx) const {
+        const int net_size = kNetSize;
         const int& height = im.rows;
         const int& width = im.cols;
-        _convert_to_square(boxes, 0.3);
         int nbox = boxes.size();
         int* return_list = new int[nbox * 8];
+        TraceScope trace(ctx.tracer_, "crop", "landmark");
         _pad(boxes, return_list, width, height);
-        Blob* input = new Blob(nbox, 3, net_size, net_size);
         int hw = net_size*net_size;
-        float* input_data = input->data();
 
         int* return_list_tmp = return_list;
         for (int i = -nbox; i; ++i) {
@@ -171,61 +221,136 @@ namespace galaxy {
                 tmp_mat.data = static_cast<uchar *>((void*)input_data);
             }
         }
+        delete[] return_list;
+    }
 
-        forward(input);
-        float* cls_scores = blobs_[8]->data();
-        float* reg = blobs_[9]->data();
-        float* landmark = blobs_[10]->data();
-        float* animoji = blobs_[11]->data();
+    void LandmarkNet::crop(const ImageView& im, const std::vector<bbox>& boxes, float* input_data,
+                           InferenceContext& ctx) const {
+        const int net_size = kNetSize;
+        TraceScope trace(ctx.tracer_, "crop", "landmark");
+        // the sampler pads out-of-image pixels itself, so no _pad pass is needed
+        for (size_t k = 0; k < boxes.size(); ++k) {
+            const bbox& box = boxes[k];
+            crop_resize_normalize(im, box.x1, box.y1, box.x2 - box.x1 + 1,
+                                  box.y2 - box.y1 + 1, input_data, net_size, net_size,
+                                  net_size, net_size*net_size, false,
+                                  1.0f/128, -127.5f/128, ctx.landmark_threadpool());
+            input_data += 3*net_size*net_size;
+        }
+    }
+
+    void LandmarkNet::predict(const cv::Mat& im, std::vector<bbox>& boxes,
+                              InferenceContext& ctx) const {
+        _convert_to_square(boxes, 0.3);
+        Blob* input = new Blob(int(boxes.size()), 3, kNetSize, kNetSize);
+        crop(im, boxes, input->data(), ctx);
+        forward(input, ctx);
+        delete input;
+        decode(boxes, im.cols, im.rows, ctx);
+    }
+
+    void LandmarkNet::predict(const ImageView& im, std::vector<bbox>& boxes,
+                              InferenceContext& ctx) const {
+        _convert_to_square(boxes, 0.3);
+        Blob* input = new Blob(int(boxes.size()), 3, kNetSize, kNetSize);
+        crop(im, boxes, input->data(), ctx);
+        forward(input, ctx);
+        delete input;
+        decode(boxes, im.width, im.height, ctx);
+    }
+
+    void LandmarkNet::predict(const std::vector<cv::Mat>& ims,
+                              std::vector<std::vector<bbox> >& boxes,
+                              InferenceContext& ctx) const {
+        assert(ims.size() == boxes.size());
+        int nbox = 0;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            _convert_to_square(boxes[i], 0.3);
+            nbox += boxes[i].size();
+        }
+        if (!nbox) return;
+        Blob* input = new Blob(nbox, 3, kNetSize, kNetSize);
+        float* input_data = input->data();
+        for (size_t i = 0; i < ims.size(); ++i) {
+            crop(ims[i], boxes[i], input_data, ctx);
+            input_data += boxes[i].size()*3*kNetSize*kNetSize;
+        }
+        forward(input, ctx);
+        delete input;
+        int first = 0;
+        for (size_t i = 0; i < ims.size(); ++i) {
+            int n = boxes[i].size();
+            decode(boxes[i], ims[i].cols, ims[i].rows, ctx, first);
+            first += n;
+        }
+    }
+
+    void LandmarkNet::decode(std::vector<bbox>& boxes, int width, int height,
+                             const InferenceContext& ctx, int first) const {
+        TraceScope trace(ctx.tracer_, "decode", "landmark");
+        const std::vector<Blob*>& blobs = ctx.landmark_blobs_;
+        const float threshold = kAcceptThreshold;
+        int nbox = boxes.size();
+        float* cls_scores = blobs[8]->data() + 2*first;
+        // cascaded heads only hold rows for the accepted boxes
+        const bool cascade = ctx.landmark_cascade_;
+        int head_first = first;
+        if (cascade) {
+            head_first = 0;
+            for (int k = 0; k < first; ++k) {
+                if (blobs[8]->data()[2 * k + 1] > threshold) head_first++;
+            }
+        }
+        const int outputs = ctx.landmark_outputs();
+        const int points = (outputs & OutputLandmarks ? 10 : 0) + (outputs & OutputAnimoji ? 140 : 0);
+        int row = 0;
         int out_idx = 0;
         for (int k = 0; k < nbox; ++k) {
             bbox& box = boxes[k];
             float scores = cls_scores[2 * k + 1];
             if (scores > threshold) {
+                int r = head_first + (cascade ? row++ : k);
                 int w = box.x2 - box.x1 + 1;
                 int h = box.y2 - box.y1 + 1;
-                float* offset = reg + 4 * k;
+                float offset[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                if (outputs & OutputBox) {
+                    const float* reg = blobs[9]->data() + 4 * r;
+                    for (int l = 0; l < 4; ++l) offset[l] = reg[l];
+                }
 
-                int x1 = (std::max)(0, box.x1+static_cast<int>(*offset++*w+0.5));
-                int y1 = (std::max)(0, box.y1+static_cast<int>(*offset++*h+0.5));
-                int x2 = (std::min)(width, box.x2+static_cast<int>(*offset++*w+0.5));
-                int y2 = (std::min)(height, box.y2+static_cast<int>(*offset++*h+0.5));
+                int x1 = (std::max)(0, box.x1+static_cast<int>(offset[0]*w+0.5));
+                int y1 = (std::max)(0, box.y1+static_cast<int>(offset[1]*h+0.5));
+                int x2 = (std::min)(width, box.x2+static_cast<int>(offset[2]*w+0.5));
+                int y2 = (std::min)(height, box.y2+static_cast<int>(offset[3]*h+0.5));
                 if (x2 > x1 && y2 > y1){
                     bbox& out_box = boxes[out_idx++];
-                    float* landmark_i = landmark + 10 * k;
-                    float* animoji_i = animoji + 140 * k;
-                    float* out_box_landmark = out_box.create_array(150);
-                    for (int l = 5; l; --l) {
-                        *out_box_landmark++ = w* *landmark_i++ + box.x1 - 1;
-                        *out_box_landmark++ = h* *landmark_i++ + box.y1 - 1;
+                    float* out_box_landmark = points ? out_box.create_array(points) : NULL;
+                    if (outputs & OutputLandmarks) {
+                        float* landmark_i = blobs[10]->data() + 10 * r;
+                        for (int l = 5; l; --l) {
+                            *out_box_landmark++ = w* *landmark_i++ + box.x1 - 1;
+                            *out_box_landmark++ = h* *landmark_i++ + box.y1 - 1;
+                        }
                     }
-                    for (int l = 70; l; --l) {
-                        *out_box_landmark++ = w* *animoji_i++ + box.x1 - 1;
-                        *out_box_landmark++ = h* *animoji_i++ + box.y1 - 1;
+                    if (outputs & OutputAnimoji) {
+                        float* animoji_i = blobs[11]->data() + 140 * r;
+                        for (int l = 70; l; --l) {
+                            *out_box_landmark++ = w* *animoji_i++ + box.x1 - 1;
+                            *out_box_landmark++ = h* *animoji_i++ + box.y1 - 1;
+                        }
                     }
 
+                    if (outputs & OutputScore) out_box.score = scores;
+                    else out_box.score = box.score;
                     out_box.x1 = x1;
                     out_box.y1 = y1;
                     out_box.x2 = x2;
                     out_box.y2 = y2;
-                    out_box.score = scores;
                 }
             }
         }
-        delete[] return_list;
-        delete input;
         boxes.resize(out_idx);
         if(out_idx > 1) nms(boxes, 0.6, true);
     }
 
-    LandmarkNet::~LandmarkNet(){
-        for (size_t i = 0; i < blobs_.size(); ++i) {
-            delete blobs_[i];
-        }
-        for (size_t i = 0; i < param_.size(); ++i) {
-            delete param_[i];
-        }
-    }
-
-
 } // galaxy
@@ -2,27 +2,39 @@
 #define LANDMARK_HPP_
 
 #include <vector>
-#include <fstream>
 #include <opencv2/opencv.hpp>
 #include "blob.hpp"
+#include "context.hpp"
+#include "image_utils.hpp"
+#include "model.hpp"
 
 #include <nnpack.h>
-#include <pthreadpool.h>
 
 namespace  galaxy {
+    // Stateless apart from the shared Model; activations live in the
+    // InferenceContext passed to each call.
     class LandmarkNet {
     public:
-        LandmarkNet(pthreadpool_t threadpool);
-        void build_net();
-        void forward(const Blob* input);
-        void load_weight(std::ifstream& infile);
-        void predict(const cv::Mat& im, std::vector<bbox>& boxes);
-        ~LandmarkNet();
+        explicit LandmarkNet(const Model* model);
+        void forward(const Blob* input, InferenceContext& ctx) const;
+        void predict(const cv::Mat& im, std::vector<bbox>& boxes, InferenceContext& ctx) const;
+        void predict(const ImageView& im, std::vector<bbox>& boxes, InferenceContext& ctx) const;
+        // boxes[i] belongs to ims[i]; all faces go through one forward pass
+        void predict(const std::vector<cv::Mat>& ims, std::vector<std::vector<bbox> >& boxes,
+                     InferenceContext& ctx) const;
 
     protected:
-        pthreadpool_t threadpool_;
-        std::vector<Blob*> param_;
-        std::vector<Blob*> blobs_;
+        void forward(const Blob* input, InferenceContext& ctx, OpThreads threads,
+                     std::vector<LayerStats>* layers) const;
+        void crop(const cv::Mat& im, const std::vector<bbox>& boxes, float* input_data,
+                  InferenceContext& ctx) const;
+        void crop(const ImageView& im, const std::vector<bbox>& boxes, float* input_data,
+                  InferenceContext& ctx) const;
+        // boxes start at row first of the output blobs
+        void decode(std::vector<bbox>& boxes, int width, int height,
+                    const InferenceContext& ctx, int first = 0) const;
+
+        const Model* model_;
     };
 } //namespace  galaxy
 #endif //LANDMARK_HPP_
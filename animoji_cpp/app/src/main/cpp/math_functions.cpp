@@ -1,14 +1,35 @@
 #include <math.h>
 #include <algorithm>
 #include <assert.h>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
+#include "backend.hpp"
+#include "direct_conv.hpp"
 #include "math_functions.hpp"
 
 namespace  galaxy {
+    Workspace::~Workspace() {
+        free(data);
+    }
+
+    void Workspace::reserve(size_t bytes) {
+        if (bytes <= size) return;
+        free(data);
+        data = NULL;
+        if (posix_memalign(&data, 64, bytes) != 0) {
+            fprintf(stderr, "Workspace allocation of %zu bytes failed\n", bytes);
+            exit(EXIT_FAILURE);
+        }
+        size = bytes;
+    }
+
     void conv_forward(const Blob* input, Blob*& output, const Blob* w,
-                      const Blob* b, pthreadpool_t threadpool, int pad0,
-                      int pad1, int stride, bool activation) {
+                      const Blob* b, threadpool_t threadpool, int pad0,
+                      int pad1, int stride, bool activation, Workspace* workspace,
+                      const Blob* transformed_w, nnp_profile* profile,
+                      const SparseWeights* sparse_w) {
         assert(input->num_axes() == 4);
         assert(w->num_axes() == 4);
         assert(b->num_axes() == 1);
@@ -18,7 +39,6 @@ namespace  galaxy {
         assert(w->shape(1) == input->shape(1));
 
         int	batch_size = input_shape[0];
-        int	image_channel = input_shape[1];
         int	image_row = input_shape[2];
         int	image_col = input_shape[3];
         int height = (image_row - kernel_shape_[2] + pad0 + pad1)/stride + 1;
@@ -34,53 +54,49 @@ namespace  galaxy {
 
         float* p_top = output->data();
         float* p_bottom = input->data();
-        float* p_w = w->data();
         float* p_b = b->data();
 
-        struct nnp_size input_size = {size_t(image_col),size_t(image_row) };
-        struct nnp_padding input_padding = { size_t(pad0),size_t(pad1),size_t(pad1),size_t(pad0)};
-        struct nnp_size kernel_size = { size_t(kernel_shape_[3]), size_t(kernel_shape_[2])};
-        enum nnp_activation activation_ = activation ?
-                                          nnp_activation_relu:
-                                          nnp_activation_identity;
-
-        if (batch_size == 1){
-            struct nnp_size stride_ = {size_t(stride), size_t(stride)};
-            nnp_convolution_inference(nnp_convolution_algorithm_auto,
-                                      nnp_convolution_transform_strategy_tuple_based,
-                                      size_t(image_channel), size_t(kernel_shape_[0]), input_size,
-                                      input_padding, kernel_size, stride_, p_bottom,
-                                      p_w, p_b, p_top, NULL, NULL, activation_,
-                                      NULL, threadpool, NULL);
-        }
-        else{
-            if (stride == 1 && batch_size > 3){
-                nnp_convolution_output(nnp_convolution_algorithm_auto, size_t(batch_size),
-                                       size_t(image_channel), size_t(kernel_shape_[0]), input_size,
-                                       input_padding, kernel_size, p_bottom,
-                                       p_w, p_b, p_top, NULL, NULL, activation_,
-                                       NULL, threadpool, NULL);
+        if (sparse_w && stride == 1 && pad0 == 0 && pad1 == 0) {
+            assert(kernel_shape_[2] == 1 && kernel_shape_[3] == 1);
+            int nb = input->count()/batch_size;
+            int nt = output->count()/batch_size;
+            if (profile) memset(profile, 0, sizeof(*profile));
+            for(int i = -batch_size; i; ++i){
+                sparse_w->conv1x1(p_bottom, height*width, p_b, p_top, threadpool);
+                p_bottom += nb;
+                p_top += nt;
             }
-            else{
-                int nb = input->count()/batch_size;
-                int nt = output->count()/batch_size;
-                struct nnp_size stride_ = {size_t(stride), size_t(stride)};
-                for(int i = -batch_size; i; ++i){
-                    nnp_convolution_inference(nnp_convolution_algorithm_auto,
-                                              nnp_convolution_transform_strategy_tuple_based,
-                                              size_t(image_channel), size_t(kernel_shape_[0]), input_size,
-                                              input_padding, kernel_size, stride_, p_bottom,
-                                              p_w, p_b, p_top, NULL, NULL, activation_,
-                                              NULL, threadpool, NULL);
-                    p_bottom += nb;
-                    p_top += nt;
-                }
+            if (activation) {
+                float* p = output->data();
+                for (int i = output->count(); i; --i, ++p) *p = (std::max)(0.0f, *p);
             }
+            return;
         }
+
+        // not yet measured against NNPACK, so only under the native backend
+        direct_conv3x3_fn direct = backend_type() == NativeBackend
+                                   && kernel_shape_[2] == 3 && kernel_shape_[3] == 3
+                                   ? find_direct_conv3x3(input_shape[1], kernel_shape_[0], stride)
+                                   : NULL;
+        if (direct) {
+            int nb = input->count()/batch_size;
+            int nt = output->count()/batch_size;
+            if (profile) memset(profile, 0, sizeof(*profile));
+            for(int i = -batch_size; i; ++i){
+                direct(p_bottom, image_row, image_col, w->data(), p_b, p_top,
+                       pad0, pad0, pad1, pad1, activation, threadpool);
+                p_bottom += nb;
+                p_top += nt;
+            }
+            return;
+        }
+
+        backend().convolution(input, output, w, b, pad0, pad1, stride, activation,
+                              workspace, transformed_w, threadpool, profile);
     }
 
     void cnn_maxpooling(const Blob* input, Blob*& output, int size, int stride,
-                        pthreadpool_t threadpool, padType pad_type) {
+                        threadpool_t threadpool, padType pad_type) {
         assert(input->num_axes() == 4);
 
         Shape input_shape = input->shape();
@@ -136,16 +152,13 @@ namespace  galaxy {
         }
         float* p_top = output->data();
         float* p_bottom = input->data();
-        struct nnp_size input_size = {size_t(col), size_t(row)};
-        struct nnp_padding input_padding = { size_t(pad0), size_t(pad3), size_t(pad1), size_t(pad2)};
-        struct nnp_size pool_size = { size_t(size),size_t(size)};
-        struct nnp_size pool_stride = {size_t(stride), size_t(stride)};
-        nnp_max_pooling_output(size_t(batch_size), size_t(k), input_size, input_padding, pool_size,
-                               pool_stride, p_bottom, p_top, threadpool);
+        backend().max_pooling(p_bottom, p_top, batch_size, k, row, col, height, width,
+                              size, stride, pad0, pad2, pad1, pad3, threadpool);
     }
 
     void fully_connected(const Blob* input, Blob*& output, const Blob* w, const Blob* b,
-                         pthreadpool_t threadpool) {
+                         threadpool_t threadpool, nnp_profile* profile,
+                         const SparseWeights* sparse_w) {
         assert(input->num_axes() == 2 || input->num_axes() == 4);
         assert(input->count()/input->shape(0) == w->shape(1));
 
@@ -171,14 +184,13 @@ namespace  galaxy {
         float* p_w = w->data();
         float* p_b = b->data();
 
-        if (batch_size == 1){
-            nnp_fully_connected_inference(size_t(input_dim), size_t(filters),
-                                          p_bottom, p_w, p_top, threadpool);
-        }
-        else{
-            nnp_fully_connected_output(size_t(batch_size), size_t(input_dim), size_t(filters),
-                                       p_bottom, p_w, p_top, threadpool, NULL);
+        if (sparse_w) {
+            if (profile) memset(profile, 0, sizeof(*profile));
+            sparse_w->fully_connected(p_bottom, batch_size, p_b, p_top, threadpool);
+            return;
         }
+        backend().fully_connected(p_bottom, batch_size, input_dim, filters, p_w, p_top,
+                                  threadpool, profile);
         for(int i = -batch_size; i; ++i){
             float* p_b_i = p_b;
             for(int j = -filters; j; ++j){
@@ -187,7 +199,7 @@ namespace  galaxy {
         }
     }
 
-    void softmax(Blob* input, pthreadpool_t threadpool) {
+    void softmax(Blob* input, threadpool_t threadpool) {
         Shape shape = input->shape();
         if(shape.size() == 4){
             int	row = shape[2];
@@ -214,15 +226,15 @@ namespace  galaxy {
         else{
             assert(shape[1] == 2);
             float* data = input->data();
-            nnp_softmax_output(size_t(shape[0]), size_t(shape[1]), data, data, threadpool);
+            backend().softmax(data, shape[0], shape[1], threadpool);
         }
     }
 
-    void leaky(Blob* input, pthreadpool_t threadpool, float alpha) {
+    void leaky(Blob* input, threadpool_t threadpool, float alpha) {
         float* data = input->data();
         int batch_size = input->shape(0);
         int c = input->count()/batch_size;
-        nnp_relu_output(size_t(batch_size), size_t(c), data, data, alpha, threadpool);
+        backend().relu(data, batch_size, c, alpha, threadpool);
     }
 
     void prelu(Blob* input, const Blob* alphas) {
@@ -245,7 +257,8 @@ namespace  galaxy {
         }
     }
 
-    void nms(std::vector<bbox>& boxes, float thresh, bool IsMin) {
+    void nms(std::vector<bbox>& boxes, float thresh, bool IsMin, int max_keep, int* dropped) {
+        if (dropped) *dropped = 0;
         sort(boxes.begin(), boxes.end(), [](bbox a, bbox b) {return a.score > b.score; });
         int num_box = static_cast<int>(boxes.size());
         if (num_box == 0) {
@@ -259,6 +272,15 @@ namespace  galaxy {
         int idx = 0;
         for (int i = 0; i < num_box; ++i) {
             if (boxes[i].score > 0) {
+                if (max_keep > 0 && idx == max_keep) {
+                    // the rest overlaps none of the kept boxes; a full NMS
+                    // would keep at most that many of them
+                    if (dropped) {
+                        for (int j = i; j < num_box; ++j)
+                            if (boxes[j].score > 0) (*dropped)++;
+                    }
+                    break;
+                }
                 for (int j = i + 1; j < num_box; ++j) {
                     if (boxes[j].score > 0) {
                         int xx1 = (std::max)(boxes[i].x1, boxes[j].x1);
@@ -282,4 +304,13 @@ namespace  galaxy {
         boxes.resize(size_t(idx));
     }
 
+    float iou(const bbox& a, const bbox& b) {
+        int w = (std::max)(0, (std::min)(a.x2, b.x2) - (std::max)(a.x1, b.x1) + 1);
+        int h = (std::max)(0, (std::min)(a.y2, b.y2) - (std::max)(a.y1, b.y1) + 1);
+        float inter = static_cast<float>(w*h);
+        float area_a = static_cast<float>((a.x2 - a.x1 + 1)*(a.y2 - a.y1 + 1));
+        float area_b = static_cast<float>((b.x2 - b.x1 + 1)*(b.y2 - b.y1 + 1));
+        return inter / (area_a + area_b - inter);
+    }
+
 }//namespace  galaxy
@@ -2,22 +2,50 @@
 #define MATH_FUNCTIONS_HPP_
 #include "blob.hpp"
 #include <nnpack.h>
-#include <pthreadpool.h>
+#include "sparse.hpp"
+#include "threadpool.hpp"
 
 namespace  galaxy {
     enum padType {None, Valid, Same};
+
+    // 64-byte aligned backend scratch memory. Until planned is set, every
+    // conv_forward queries its requirement and grows the buffer; afterwards
+    // the buffer is used as is.
+    struct Workspace {
+        Workspace(): data(NULL), size(0), planned(false) {}
+        ~Workspace();
+        void reserve(size_t bytes);
+
+        void* data;
+        size_t size;
+        bool planned;
+    private:
+        Workspace(const Workspace&);
+        Workspace& operator=(const Workspace&);
+    };
+
     void conv_forward(const Blob* input, Blob*& output, const Blob* w,
-                      const Blob* b, pthreadpool_t threadpool, int pad0=0,
-                      int pad1=0, int stride=1, bool activation=false);
+                      const Blob* b, threadpool_t threadpool, int pad0=0,
+                      int pad1=0, int stride=1, bool activation=false,
+                      Workspace* workspace=NULL, const Blob* transformed_w=NULL,
+                      nnp_profile* profile=NULL, const SparseWeights* sparse_w=NULL);
 
     void cnn_maxpooling(const Blob* input, Blob*& output, int size, int stride,
-                        pthreadpool_t threadpool, padType pad_type = Same);
+                        threadpool_t threadpool, padType pad_type = Same);
 
+    // sparse_w, the compressed form of a pruned w, replaces the dense backend kernels
     void fully_connected(const Blob* input, Blob*& output, const Blob* w, const Blob* b,
-                             pthreadpool_t threadpool);
-    void softmax(Blob* input, pthreadpool_t threadpool);
-    void leaky(Blob* input, pthreadpool_t threadpool, float alpha = 0.1f);
+                             threadpool_t threadpool, nnp_profile* profile=NULL,
+                             const SparseWeights* sparse_w=NULL);
+    void softmax(Blob* input, threadpool_t threadpool);
+    void leaky(Blob* input, threadpool_t threadpool, float alpha = 0.1f);
     void prelu(Blob* input, const Blob* alphas);
-    void nms(std::vector<bbox>& boxes, float thresh, bool IsMin=false);
+    // max_keep > 0 keeps at most that many boxes, and NMS stops there.
+    // dropped, when given, gets the boxes left that overlap no kept box: an
+    // upper bound on the further boxes a full NMS would have kept, since
+    // they are not suppressed among each other.
+    void nms(std::vector<bbox>& boxes, float thresh, bool IsMin=false,
+             int max_keep=0, int* dropped=NULL);
+    float iou(const bbox& a, const bbox& b);
 } //namespace  galaxy
 #endif //MATH_FUNCTIONS_HPP_
@@ -0,0 +1,426 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "backend.hpp"
+#include "model.hpp"
+
+namespace  galaxy {
+    Model::Model()
+        :mapping_(NULL), mapping_size_(0), mapped_(false){
+        build_detect_net();
+        build_landmark_net();
+    }
+
+    Model::Model(void* mapping, size_t size, bool mapped)
+        :mapping_(mapping), mapping_size_(size), mapped_(mapped){
+    }
+
+    // Parameter shapes in file order; snapshots must match them exactly.
+    static const std::vector<Shape>& detect_net_shapes(){
+        static const std::vector<Shape> shapes = {
+            {8, 3, 3, 3}, {8},
+            {12, 8, 3, 3}, {12},
+            {16, 12, 3, 3}, {16},
+            {8, 16, 1, 1}, {8},
+            {16, 8, 3, 3}, {16},
+            {32, 16, 3, 3}, {32},
+            {16, 32, 1, 1}, {16},
+            {32, 16, 3, 3}, {32},
+            {64, 32, 3, 3}, {64},
+            {32, 64, 1, 1}, {32},
+            {64, 32, 3, 3}, {64},
+            {32, 64, 1, 1}, {32},
+            {64, 32, 3, 3}, {64},
+            {30, 64, 1, 1}, {30},
+        };
+        return shapes;
+    }
+
+    static const std::vector<Shape>& landmark_net_shapes(){
+        static const std::vector<Shape> shapes = {
+            {32, 3, 3, 3}, {32}, {32},
+            {64, 32, 3, 3}, {64}, {64},
+            {64, 64, 3, 3}, {64}, {64},
+            {128, 64, 2, 2}, {128}, {128},
+            {256, 128*3*3}, {256}, {256},
+            {2, 256}, {2},
+            {4, 256}, {4},
+            {10, 256}, {10},
+            {140, 256}, {140},
+        };
+        return shapes;
+    }
+
+    void Model::build_detect_net(){
+        const std::vector<Shape>& shapes = detect_net_shapes();
+        detect_param_.reserve(shapes.size());
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            detect_param_.push_back(new Blob(shapes[i]));
+        }
+        detect_transform_.resize(detect_param_.size());
+        detect_sparse_.resize(detect_param_.size());
+    }
+
+    void Model::build_landmark_net(){
+        const std::vector<Shape>& shapes = landmark_net_shapes();
+        landmark_param_.reserve(shapes.size());
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            landmark_param_.push_back(new Blob(shapes[i]));
+        }
+        landmark_transform_.resize(landmark_param_.size());
+        landmark_sparse_.resize(landmark_param_.size());
+    }
+
+    static void read_param(std::ifstream& infile, const std::vector<Blob*>& param){
+        for (size_t i = 0; i < param.size(); ++i) {
+            infile.read((char*)param[i]->data(), param[i]->count()*sizeof(float));
+            assert(infile.gcount() == param[i]->count()*sizeof(float));
+        }
+    }
+
+    void Model::load_weight(const std::string& model_path) {
+        std::ifstream infile(model_path.c_str(), std::ifstream::binary);
+        if (!infile.is_open()) {
+            std::cout << "Open file fail: " << model_path << std::endl;
+            exit(1);
+        }
+        read_param(infile, detect_param_);
+        read_param(infile, landmark_param_);
+        infile.close();
+        precompute_transforms(detect_param_, detect_transform_);
+        precompute_transforms(landmark_param_, landmark_transform_);
+        compress_sparse(detect_param_, detect_sparse_);
+        compress_sparse(landmark_param_, landmark_sparse_);
+    }
+
+    bool Model::load_weight(const void* data, size_t size) {
+        const std::vector<Blob*>* sets[2] = {&detect_param_, &landmark_param_};
+        size_t expected = 0;
+        for (int k = 0; k < 2; ++k) {
+            for (size_t i = 0; i < sets[k]->size(); ++i) expected += (*sets[k])[i]->count()*sizeof(float);
+        }
+        if (size < expected) return false;
+        const char* p = static_cast<const char*>(data);
+        for (int k = 0; k < 2; ++k) {
+            for (size_t i = 0; i < sets[k]->size(); ++i) {
+                Blob* b = (*sets[k])[i];
+                memcpy(b->data(), p, b->count()*sizeof(float));
+                p += b->count()*sizeof(float);
+            }
+        }
+        precompute_transforms(detect_param_, detect_transform_);
+        precompute_transforms(landmark_param_, landmark_transform_);
+        compress_sparse(detect_param_, detect_sparse_);
+        compress_sparse(landmark_param_, landmark_sparse_);
+        return true;
+    }
+
+    // Kernel transforms of the current backend, so inference skips the
+    // per-call transform; NULL entries use the plain weights.
+    void Model::precompute_transforms(const std::vector<Blob*>& param,
+                                      std::vector<Blob*>& transform){
+        for (size_t i = 0; i < param.size(); ++i) {
+            delete transform[i];
+            transform[i] = backend().transform_kernel(param[i]);
+        }
+    }
+
+    // Pruned FC and 1x1 layers: their zeros are in the plain weights, so
+    // every load path finds them here. pruned, when given, limits the scan
+    // to the layers it marks.
+    void Model::compress_sparse(const std::vector<Blob*>& param,
+                                std::vector<SparseWeights*>& sparse,
+                                const std::vector<bool>* pruned){
+        for (size_t i = 0; i < sparse.size(); ++i) {
+            delete sparse[i];
+        }
+        sparse.assign(param.size(), NULL);
+        for (size_t i = 0; i < param.size(); ++i) {
+            // biases and PReLU slopes are 1-axis blobs
+            if (param[i]->num_axes() < 2) continue;
+            if (pruned && !(*pruned)[i]) continue;
+            sparse[i] = SparseWeights::compress(param[i]);
+        }
+    }
+
+    // Snapshot layout: header, tensor table, arena table, then the tensor
+    // data, each tensor 64-byte aligned like a Blob so it is used in place.
+    // Version 2 flags the pruned layers; version 1 files left that word
+    // zero, so all their FC and 1x1 layers are scanned as before.
+    static const char kSnapshotMagic[4] = {'G', 'S', 'N', '1'};
+    static const uint32_t kSnapshotVersion = 2;
+
+    static const char* snapshot_arch(){
+#if defined(__aarch64__)
+        return "arm64";
+#elif defined(__arm__)
+        return "arm";
+#elif defined(__x86_64__)
+        return "x86_64";
+#elif defined(__i386__)
+        return "x86";
+#else
+        return "generic";
+#endif
+    }
+
+    // Transformed kernels belong to the backend and, for NNPACK, to the
+    // SIMD code it was built with.
+    static std::string snapshot_target(){
+        std::string target = snapshot_arch();
+        if (backend_type() != NnpackBackend) target += "-native";
+        return target;
+    }
+
+    struct SnapshotHeader {
+        char magic[4];
+        uint32_t version;
+        char target[16];
+        uint32_t tensors;
+        uint32_t arenas;
+        uint64_t size;
+    };
+
+    enum snapshotKind {DetectParam, DetectTransform, LandmarkParam, LandmarkTransform};
+
+    // a param the loader compresses to SparseWeights
+    static const uint32_t kSnapshotPruned = 1;
+
+    struct SnapshotTensor {
+        uint32_t kind;
+        uint32_t index;
+        uint32_t axes;
+        int32_t shape[4];
+        uint32_t flags;
+        uint64_t offset;
+    };
+
+    struct SnapshotArena {
+        int32_t width;
+        int32_t height;
+        uint64_t workspace;
+    };
+
+    static size_t align64(size_t n){
+        return (n + 63) & ~size_t(63);
+    }
+
+    bool Model::is_snapshot(const std::string& path){
+        std::ifstream infile(path.c_str(), std::ifstream::binary);
+        char magic[4];
+        infile.read(magic, sizeof(magic));
+        return infile.gcount() == sizeof(magic) && memcmp(magic, kSnapshotMagic, sizeof(magic)) == 0;
+    }
+
+    bool Model::is_snapshot(const void* data, size_t size){
+        return size >= sizeof(kSnapshotMagic) && memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0;
+    }
+
+    void Model::save_snapshot(const std::string& path, const std::vector<ArenaSize>& arenas) const{
+        const std::vector<Blob*>* sets[4] = {&detect_param_, &detect_transform_,
+                                             &landmark_param_, &landmark_transform_};
+        const std::vector<SparseWeights*>* sparse[4] = {&detect_sparse_, NULL,
+                                                        &landmark_sparse_, NULL};
+        std::vector<SnapshotTensor> tensors;
+        std::vector<const Blob*> blobs;
+        for (uint32_t k = 0; k < 4; ++k) {
+            for (size_t i = 0; i < sets[k]->size(); ++i) {
+                const Blob* b = (*sets[k])[i];
+                if (!b) continue;
+                assert(b->num_axes() <= 4);
+                SnapshotTensor t;
+                memset(&t, 0, sizeof(t));
+                t.kind = k;
+                t.index = static_cast<uint32_t>(i);
+                t.axes = static_cast<uint32_t>(b->num_axes());
+                for (int a = 0; a < b->num_axes(); ++a) t.shape[a] = b->shape(a);
+                if (sparse[k] && i < sparse[k]->size() && (*sparse[k])[i]) t.flags = kSnapshotPruned;
+                tensors.push_back(t);
+                blobs.push_back(b);
+            }
+        }
+        size_t offset = align64(sizeof(SnapshotHeader) + tensors.size()*sizeof(SnapshotTensor)
+                                + arenas.size()*sizeof(SnapshotArena));
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            tensors[i].offset = offset;
+            offset = align64(offset + blobs[i]->count()*sizeof(float));
+        }
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+        header.version = kSnapshotVersion;
+        strncpy(header.target, snapshot_target().c_str(), sizeof(header.target) - 1);
+        header.tensors = static_cast<uint32_t>(tensors.size());
+        header.arenas = static_cast<uint32_t>(arenas.size());
+        header.size = offset;
+
+        std::vector<char> file(offset, 0);
+        char* p = &file[0];
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        if (!tensors.empty()) memcpy(p, &tensors[0], tensors.size()*sizeof(SnapshotTensor));
+        p += tensors.size()*sizeof(SnapshotTensor);
+        for (size_t i = 0; i < arenas.size(); ++i, p += sizeof(SnapshotArena)) {
+            SnapshotArena a = {arenas[i].width, arenas[i].height, arenas[i].workspace};
+            memcpy(p, &a, sizeof(a));
+        }
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            memcpy(&file[tensors[i].offset], blobs[i]->data(), blobs[i]->count()*sizeof(float));
+        }
+
+        std::ofstream outfile(path.c_str(), std::ofstream::binary);
+        if (!outfile.is_open()) {
+            std::cout << "Open file fail: " << path << std::endl;
+            exit(1);
+        }
+        outfile.write(&file[0], file.size());
+    }
+
+    // Failures are reported and return an empty pointer, so that embedders
+    // can refuse a bad file without exiting.
+    std::shared_ptr<Model> Model::load_snapshot(const std::string& path){
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) close(fd);
+            std::cout << "Open file fail: " << path << std::endl;
+            return std::shared_ptr<Model>();
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            fprintf(stderr, "mmap failed: %s\n", path.c_str());
+            return std::shared_ptr<Model>();
+        }
+        std::shared_ptr<Model> model(new Model(mapping, size, true));
+        if (!model->map_snapshot(path)) model.reset();
+        return model;
+    }
+
+    // One aligned copy of the whole image; the caller's buffer can go away.
+    std::shared_ptr<Model> Model::load_snapshot(const void* data, size_t size){
+        void* copy = NULL;
+        if (posix_memalign(&copy, 64, size > 0 ? size : 64) != 0) return std::shared_ptr<Model>();
+        memcpy(copy, data, size);
+        std::shared_ptr<Model> model(new Model(copy, size, false));
+        if (!model->map_snapshot("<memory>")) model.reset();
+        return model;
+    }
+
+    // Blobs become views into the mapping; the only work per tensor is
+    // creating its view. Anything that does not describe exactly the nets
+    // of build_detect_net and build_landmark_net is rejected; blobs made
+    // before the failure go with the Model.
+    bool Model::map_snapshot(const std::string& path){
+        const char* base = static_cast<const char*>(mapping_);
+        const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(base);
+        if (mapping_size_ < sizeof(SnapshotHeader)
+            || memcmp(header->magic, kSnapshotMagic, sizeof(header->magic)) != 0
+            || header->version < 1 || header->version > kSnapshotVersion
+            || header->size != mapping_size_) {
+            fprintf(stderr, "Not a model snapshot: %s\n", path.c_str());
+            return false;
+        }
+        if (sizeof(SnapshotHeader) + header->tensors*sizeof(SnapshotTensor)
+            + header->arenas*sizeof(SnapshotArena) > mapping_size_) {
+            fprintf(stderr, "Corrupt model snapshot: %s\n", path.c_str());
+            return false;
+        }
+        bool same_target = strncmp(header->target, snapshot_target().c_str(), sizeof(header->target)) == 0;
+        const SnapshotTensor* tensors = reinterpret_cast<const SnapshotTensor*>(header + 1);
+        const SnapshotArena* arenas = reinterpret_cast<const SnapshotArena*>(tensors + header->tensors);
+
+        const std::vector<Shape>& detect_shapes = detect_net_shapes();
+        const std::vector<Shape>& landmark_shapes = landmark_net_shapes();
+        detect_param_.assign(detect_shapes.size(), NULL);
+        detect_transform_.assign(detect_shapes.size(), NULL);
+        landmark_param_.assign(landmark_shapes.size(), NULL);
+        landmark_transform_.assign(landmark_shapes.size(), NULL);
+        std::vector<Blob*>* sets[4] = {&detect_param_, &detect_transform_,
+                                       &landmark_param_, &landmark_transform_};
+        const std::vector<Shape>* shapes[4] = {&detect_shapes, &detect_shapes,
+                                               &landmark_shapes, &landmark_shapes};
+        std::vector<bool> detect_pruned(detect_shapes.size(), false);
+        std::vector<bool> landmark_pruned(landmark_shapes.size(), false);
+        std::vector<bool>* pruned[4] = {&detect_pruned, NULL, &landmark_pruned, NULL};
+        for (uint32_t i = 0; i < header->tensors; ++i) {
+            const SnapshotTensor& t = tensors[i];
+            bool valid = t.kind < 4 && t.axes <= 4 && t.index < sets[t.kind]->size()
+                         && !(*sets[t.kind])[t.index] && t.offset % 64 == 0
+                         && t.offset <= mapping_size_;
+            Shape shape(t.shape, t.shape + (valid ? t.axes : 0));
+            if (valid && (t.kind == DetectParam || t.kind == LandmarkParam)) {
+                valid = shape == (*shapes[t.kind])[t.index];
+            }
+            else if (valid) {
+                // a flat buffer, only for the 3x3 convolutions
+                const Shape& w = (*shapes[t.kind])[t.index];
+                valid = shape.size() == 1 && shape[0] > 0
+                        && w.size() == 4 && w[2] == 3 && w[3] == 3;
+            }
+            size_t count = 1;
+            for (size_t a = 0; a < shape.size(); ++a) count *= size_t(shape[a]);
+            if (!valid || count*sizeof(float) > mapping_size_ - t.offset) {
+                fprintf(stderr, "Corrupt model snapshot: %s\n", path.c_str());
+                return false;
+            }
+            if (pruned[t.kind]) (*pruned[t.kind])[t.index] = (t.flags & kSnapshotPruned) != 0;
+            if ((t.kind == DetectTransform || t.kind == LandmarkTransform) && !same_target) continue;
+            (*sets[t.kind])[t.index] = new Blob(shape, reinterpret_cast<float*>(const_cast<char*>(base + t.offset)));
+        }
+        for (int k = 0; k < 4; k += 2) {
+            for (size_t i = 0; i < sets[k]->size(); ++i) {
+                if ((*sets[k])[i]) continue;
+                fprintf(stderr, "Incomplete model snapshot: %s\n", path.c_str());
+                return false;
+            }
+        }
+        if (!same_target) {
+            precompute_transforms(detect_param_, detect_transform_);
+            precompute_transforms(landmark_param_, landmark_transform_);
+        }
+        // only the flagged layers are read again, the rest stays untouched
+        // in the mapping
+        if (header->version == 1) {
+            compress_sparse(detect_param_, detect_sparse_);
+            compress_sparse(landmark_param_, landmark_sparse_);
+        }
+        else {
+            compress_sparse(detect_param_, detect_sparse_, &detect_pruned);
+            compress_sparse(landmark_param_, landmark_sparse_, &landmark_pruned);
+        }
+        for (uint32_t i = 0; i < header->arenas; ++i) {
+            ArenaSize a = {arenas[i].width, arenas[i].height, size_t(arenas[i].workspace)};
+            arenas_.push_back(a);
+        }
+        return true;
+    }
+
+    static void delete_all(std::vector<Blob*>& blobs){
+        for (size_t i = 0; i < blobs.size(); ++i) {
+            delete blobs[i];
+        }
+    }
+
+    Model::~Model(){
+        delete_all(detect_param_);
+        delete_all(detect_transform_);
+        delete_all(landmark_param_);
+        delete_all(landmark_transform_);
+        for (size_t i = 0; i < detect_sparse_.size(); ++i) delete detect_sparse_[i];
+        for (size_t i = 0; i < landmark_sparse_.size(); ++i) delete landmark_sparse_[i];
+        if (mapping_ && mapped_) munmap(mapping_, mapping_size_);
+        else free(mapping_);
+    }
+} //namespace  galaxy
@@ -0,0 +1,87 @@
+#ifndef MODEL_HPP_
+#define MODEL_HPP_
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "blob.hpp"
+#include "sparse.hpp"
+
+namespace  galaxy {
+    // Detector workspace a plan of this input size needed when a snapshot
+    // was written, so the plan can reserve it up front.
+    struct ArenaSize {
+        int width;
+        int height;
+        size_t workspace;
+    };
+
+    // Read-only weights of the detector and the landmark net, plus the
+    // backend's transforms of their kernels. After load_weight a Model is
+    // never written again, so any number of InferenceContexts may run on one
+    // instance at the same time.
+    class Model {
+    public:
+        Model();
+        ~Model();
+        void load_weight(const std::string& model_path);
+        // Raw weights already in memory; false when data is too short.
+        bool load_weight(const void* data, size_t size);
+
+        // Snapshots hold the model in its execution form: the weights, the
+        // precomputed kernel transforms and the arena sizes, laid out so that
+        // one read-only mmap is the whole load. Transforms are only valid for
+        // the CPU architecture and backend that wrote them; on another one
+        // they are dropped and recomputed from the weights. Layers that were
+        // sparse when the snapshot was written are flagged, and only those
+        // are compressed again at load.
+        static bool is_snapshot(const std::string& path);
+        static bool is_snapshot(const void* data, size_t size);
+        // Empty on a missing or malformed snapshot.
+        static std::shared_ptr<Model> load_snapshot(const std::string& path);
+        static std::shared_ptr<Model> load_snapshot(const void* data, size_t size);
+        void save_snapshot(const std::string& path,
+                           const std::vector<ArenaSize>& arenas = std::vector<ArenaSize>()) const;
+        const std::vector<ArenaSize>& arenas() const { return arenas_; }
+
+        const std::vector<Blob*>& detect_param() const { return detect_param_; }
+        const std::vector<Blob*>& landmark_param() const { return landmark_param_; }
+        // Entry i is the precomputed transform of param i, or NULL when the
+        // layer is not a 3x3 convolution.
+        const std::vector<Blob*>& detect_transform() const { return detect_transform_; }
+        const std::vector<Blob*>& landmark_transform() const { return landmark_transform_; }
+        // Entry i is the block-sparse form of param i, or NULL when the layer
+        // is not an FC or 1x1 convolution or is too dense to gain from it.
+        const std::vector<SparseWeights*>& detect_sparse() const { return detect_sparse_; }
+        const std::vector<SparseWeights*>& landmark_sparse() const { return landmark_sparse_; }
+
+    protected:
+        // snapshot models: no blobs are allocated, map_snapshot fills them in.
+        // mapping is munmap'ed when mapped, freed otherwise.
+        Model(void* mapping, size_t size, bool mapped);
+        bool map_snapshot(const std::string& path);
+        void build_detect_net();
+        void build_landmark_net();
+        void precompute_transforms(const std::vector<Blob*>& param,
+                                   std::vector<Blob*>& transform);
+        void compress_sparse(const std::vector<Blob*>& param,
+                             std::vector<SparseWeights*>& sparse,
+                             const std::vector<bool>* pruned = NULL);
+
+        std::vector<Blob*> detect_param_;
+        std::vector<Blob*> landmark_param_;
+        std::vector<Blob*> detect_transform_;
+        std::vector<Blob*> landmark_transform_;
+        std::vector<SparseWeights*> detect_sparse_;
+        std::vector<SparseWeights*> landmark_sparse_;
+        std::vector<ArenaSize> arenas_;
+        void* mapping_;
+        size_t mapping_size_;
+        bool mapped_;
+    private:
+        Model(const Model&);
+        Model& operator=(const Model&);
+    };
+} //namespace  galaxy
+#endif //MODEL_HPP_
@@ -0,0 +1,451 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "backend.hpp"
+#include "math_functions.hpp"
+#include "simd.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GALAXY_NATIVE_AVX2
+#endif
+
+// Portable kernels for hosts without NNPACK. Convolutions and FC layers are
+// one SGEMM, C (m, n) = A (m, k) * B (k, n): A and B are packed into panels
+// of MR rows and NR columns so the register tile reads both sequentially,
+// and the packed B of a convolution is its im2col matrix, built straight
+// from the image. Tasks cover kBlock x kBlock of C, small enough that
+// their A and B panels stay in L2 for the layers of this model.
+namespace  galaxy {
+    static const int kNR = 8;
+    static const int kBlock = 64;
+
+    // c (mr x kNR, row-major) = a panel * b panel over k
+    typedef void (*gemm_kernel)(int k, const float* a, const float* b, float* c);
+
+    static void kernel_4x8(int k, const float* a, const float* b, float* c) {
+        v4f c00 = v4f_set1(0.0f), c01 = c00, c10 = c00, c11 = c00;
+        v4f c20 = c00, c21 = c00, c30 = c00, c31 = c00;
+        for (int p = -k; p; ++p) {
+            const v4f b0 = v4f_load(b);
+            const v4f b1 = v4f_load(b + 4);
+            v4f a0 = v4f_set1(a[0]);
+            c00 = v4f_fmadd(a0, b0, c00);
+            c01 = v4f_fmadd(a0, b1, c01);
+            a0 = v4f_set1(a[1]);
+            c10 = v4f_fmadd(a0, b0, c10);
+            c11 = v4f_fmadd(a0, b1, c11);
+            a0 = v4f_set1(a[2]);
+            c20 = v4f_fmadd(a0, b0, c20);
+            c21 = v4f_fmadd(a0, b1, c21);
+            a0 = v4f_set1(a[3]);
+            c30 = v4f_fmadd(a0, b0, c30);
+            c31 = v4f_fmadd(a0, b1, c31);
+            a += 4;
+            b += kNR;
+        }
+        v4f_store(c, c00);
+        v4f_store(c + 4, c01);
+        v4f_store(c + 8, c10);
+        v4f_store(c + 12, c11);
+        v4f_store(c + 16, c20);
+        v4f_store(c + 20, c21);
+        v4f_store(c + 24, c30);
+        v4f_store(c + 28, c31);
+    }
+
+#ifdef GALAXY_NATIVE_AVX2
+    // 8 accumulators of 8 lanes hide the FMA latency on both ports
+    __attribute__((target("avx2,fma")))
+    static void kernel_8x8_avx2(int k, const float* a, const float* b, float* c) {
+        __m256 c0 = _mm256_setzero_ps(), c1 = c0, c2 = c0, c3 = c0;
+        __m256 c4 = c0, c5 = c0, c6 = c0, c7 = c0;
+        for (int p = -k; p; ++p) {
+            const __m256 b0 = _mm256_loadu_ps(b);
+            c0 = _mm256_fmadd_ps(_mm256_broadcast_ss(a), b0, c0);
+            c1 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 1), b0, c1);
+            c2 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 2), b0, c2);
+            c3 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 3), b0, c3);
+            c4 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 4), b0, c4);
+            c5 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 5), b0, c5);
+            c6 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 6), b0, c6);
+            c7 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 7), b0, c7);
+            a += 8;
+            b += kNR;
+        }
+        _mm256_storeu_ps(c, c0);
+        _mm256_storeu_ps(c + 8, c1);
+        _mm256_storeu_ps(c + 16, c2);
+        _mm256_storeu_ps(c + 24, c3);
+        _mm256_storeu_ps(c + 32, c4);
+        _mm256_storeu_ps(c + 40, c5);
+        _mm256_storeu_ps(c + 48, c6);
+        _mm256_storeu_ps(c + 56, c7);
+    }
+#endif
+
+    // one image of a convolution seen as B (k, n): k runs over (channel,
+    // ky, kx) and n over the output pixels
+    struct im2col_view {
+        const float* image;
+        int height, width;
+        int kernel_h, kernel_w;
+        int stride, pad;
+        int out_width;
+    };
+
+    struct gemm_context {
+        int m, n, k, mr;
+        gemm_kernel kernel;
+        const float* a;
+        int lda;
+        // B (p, j) = b[p*b_ks + j*b_ns], or the im2col of view when set
+        const float* b;
+        int b_ks, b_ns;
+        const im2col_view* view;
+        // C (i, j) = c[i*c_ms + j*c_ns]
+        float* c;
+        int c_ms, c_ns;
+        const float* bias;      // per row of C, may be NULL
+        bool relu;
+        float* packed_a;
+        float* packed_b;
+    };
+
+    static void pack_a(void* argument, size_t panel) {
+        const gemm_context* ctx = static_cast<const gemm_context*>(argument);
+        const int mr = ctx->mr;
+        const int i0 = static_cast<int>(panel)*mr;
+        const int rows = (std::min)(mr, ctx->m - i0);
+        float* dst = ctx->packed_a + size_t(panel)*mr*ctx->k;
+        for (int r = 0; r < mr; ++r) {
+            float* d = dst + r;
+            if (r >= rows) {
+                for (int p = -ctx->k; p; ++p, d += mr) *d = 0.0f;
+                continue;
+            }
+            const float* s = ctx->a + (i0 + r)*ctx->lda;
+            for (int p = -ctx->k; p; ++p, d += mr) *d = *s++;
+        }
+    }
+
+    static void pack_b(void* argument, size_t panel) {
+        const gemm_context* ctx = static_cast<const gemm_context*>(argument);
+        const int j0 = static_cast<int>(panel)*kNR;
+        const int cols = (std::min)(kNR, ctx->n - j0);
+        float* dst = ctx->packed_b + size_t(panel)*kNR*ctx->k;
+        if (!ctx->view) {
+            for (int p = 0; p < ctx->k; ++p, dst += kNR) {
+                const float* s = ctx->b + p*ctx->b_ks + j0*ctx->b_ns;
+                int jj = 0;
+                if (ctx->b_ns == 1) {
+                    for (; jj < cols; ++jj) dst[jj] = s[jj];
+                } else {
+                    for (; jj < cols; ++jj) dst[jj] = s[jj*ctx->b_ns];
+                }
+                for (; jj < kNR; ++jj) dst[jj] = 0.0f;
+            }
+            return;
+        }
+
+        const im2col_view& v = *ctx->view;
+        int y0[kNR], x0[kNR];
+        for (int jj = 0; jj < kNR; ++jj) {
+            int j = jj < cols ? j0 + jj : j0;
+            y0[jj] = (j/v.out_width)*v.stride - v.pad;
+            x0[jj] = (j%v.out_width)*v.stride - v.pad;
+        }
+        const int channels = ctx->k/(v.kernel_h*v.kernel_w);
+        const float* plane = v.image;
+        for (int ch = 0; ch < channels; ++ch, plane += v.height*v.width) {
+            for (int ky = 0; ky < v.kernel_h; ++ky) {
+                for (int kx = 0; kx < v.kernel_w; ++kx, dst += kNR) {
+                    for (int jj = 0; jj < kNR; ++jj) {
+                        const int y = y0[jj] + ky;
+                        const int x = x0[jj] + kx;
+                        bool inside = jj < cols && y >= 0 && y < v.height && x >= 0 && x < v.width;
+                        dst[jj] = inside ? plane[y*v.width + x] : 0.0f;
+                    }
+                }
+            }
+        }
+    }
+
+    static void store_tile(const gemm_context* ctx, const float* tile, int i0, int j0) {
+        const int rows = (std::min)(ctx->mr, ctx->m - i0);
+        const int cols = (std::min)(kNR, ctx->n - j0);
+        for (int r = 0; r < rows; ++r) {
+            const float* t = tile + r*kNR;
+            float* c = ctx->c + (i0 + r)*ctx->c_ms + j0*ctx->c_ns;
+            const float bias = ctx->bias ? ctx->bias[i0 + r] : 0.0f;
+            if (ctx->c_ns == 1 && cols == kNR) {
+                v4f lo = v4f_add(v4f_load(t), v4f_set1(bias));
+                v4f hi = v4f_add(v4f_load(t + 4), v4f_set1(bias));
+                if (ctx->relu) {
+                    lo = v4f_max(lo, v4f_set1(0.0f));
+                    hi = v4f_max(hi, v4f_set1(0.0f));
+                }
+                v4f_store(c, lo);
+                v4f_store(c + 4, hi);
+                continue;
+            }
+            for (int jj = 0; jj < cols; ++jj) {
+                float x = t[jj] + bias;
+                c[jj*ctx->c_ns] = ctx->relu ? (std::max)(x, 0.0f) : x;
+            }
+        }
+    }
+
+    static void gemm_block(void* argument, size_t bi, size_t bj) {
+        const gemm_context* ctx = static_cast<const gemm_context*>(argument);
+        const int mr = ctx->mr;
+        const int i_end = (std::min)(ctx->m, (static_cast<int>(bi) + 1)*kBlock);
+        const int j_end = (std::min)(ctx->n, (static_cast<int>(bj) + 1)*kBlock);
+        float tile[8*kNR];
+        for (int j = static_cast<int>(bj)*kBlock; j < j_end; j += kNR) {
+            const float* b = ctx->packed_b + size_t(j/kNR)*kNR*ctx->k;
+            for (int i = static_cast<int>(bi)*kBlock; i < i_end; i += mr) {
+                ctx->kernel(ctx->k, ctx->packed_a + size_t(i/mr)*mr*ctx->k, b, tile);
+                store_tile(ctx, tile, i, j);
+            }
+        }
+    }
+
+    static size_t round_up(int x, int multiple) {
+        return size_t((x + multiple - 1)/multiple*multiple);
+    }
+
+    // packed A and B of ctx, from workspace when it is large enough
+    static void place_panels(gemm_context& ctx, Workspace* workspace) {
+        size_t a_size = round_up(ctx.m, ctx.mr)*ctx.k;
+        size_t bytes = (a_size + round_up(ctx.n, kNR)*ctx.k)*sizeof(float);
+        float* data = NULL;
+        if (workspace) {
+            if (!workspace->planned) workspace->reserve(bytes);
+            if (workspace->size >= bytes) data = static_cast<float*>(workspace->data);
+        }
+        if (!data) {
+            static thread_local Workspace local;
+            local.reserve(bytes);
+            data = static_cast<float*>(local.data);
+        }
+        ctx.packed_a = data;
+        ctx.packed_b = data + a_size;
+    }
+
+    static void run_gemm(const gemm_context& ctx, threadpool_t threadpool, bool pack_a_panels) {
+        gemm_context* c = const_cast<gemm_context*>(&ctx);
+        if (pack_a_panels)
+            threadpool_compute_1d(threadpool, pack_a, c, size_t((ctx.m + ctx.mr - 1)/ctx.mr));
+        threadpool_compute_1d(threadpool, pack_b, c, size_t((ctx.n + kNR - 1)/kNR));
+        threadpool_compute_2d(threadpool, gemm_block, c, size_t((ctx.m + kBlock - 1)/kBlock),
+                              size_t((ctx.n + kBlock - 1)/kBlock));
+    }
+
+    // FC rows for batches too small to fill a register tile: a dot product
+    // per output, 16 outputs per task
+    struct gemv_context {
+        const float* input;
+        int batch, input_dim, filters;
+        const float* w;
+        float* output;
+    };
+
+    static void gemv_rows(void* argument, size_t task) {
+        const gemv_context* ctx = static_cast<const gemv_context*>(argument);
+        const int f_end = (std::min)(ctx->filters, (static_cast<int>(task) + 1)*16);
+        for (int f = static_cast<int>(task)*16; f < f_end; ++f) {
+            const float* w = ctx->w + f*ctx->input_dim;
+            for (int n = 0; n < ctx->batch; ++n) {
+                const float* x = ctx->input + n*ctx->input_dim;
+                v4f acc0 = v4f_set1(0.0f), acc1 = acc0;
+                int p = 0;
+                for (; p + 8 <= ctx->input_dim; p += 8) {
+                    acc0 = v4f_fmadd(v4f_load(w + p), v4f_load(x + p), acc0);
+                    acc1 = v4f_fmadd(v4f_load(w + p + 4), v4f_load(x + p + 4), acc1);
+                }
+                float lanes[4];
+                v4f_store(lanes, v4f_add(acc0, acc1));
+                float sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                for (; p < ctx->input_dim; ++p) sum += w[p]*x[p];
+                ctx->output[n*ctx->filters + f] = sum;
+            }
+        }
+    }
+
+    struct pool_context {
+        const float* input;
+        float* output;
+        int height, width, out_height, out_width;
+        int size, stride, pad_top, pad_left;
+    };
+
+    static void max_pool_plane(void* argument, size_t plane) {
+        const pool_context* ctx = static_cast<const pool_context*>(argument);
+        const float* in = ctx->input + plane*ctx->height*ctx->width;
+        float* out = ctx->output + plane*ctx->out_height*ctx->out_width;
+        for (int oy = 0; oy < ctx->out_height; ++oy) {
+            const int y0 = oy*ctx->stride - ctx->pad_top;
+            const int y_begin = (std::max)(y0, 0);
+            const int y_end = (std::min)(y0 + ctx->size, ctx->height);
+            for (int ox = 0; ox < ctx->out_width; ++ox) {
+                const int x0 = ox*ctx->stride - ctx->pad_left;
+                const int x_begin = (std::max)(x0, 0);
+                const int x_end = (std::min)(x0 + ctx->size, ctx->width);
+                float m = -INFINITY;
+                for (int y = y_begin; y < y_end; ++y) {
+                    const float* row = in + y*ctx->width;
+                    for (int x = x_begin; x < x_end; ++x) m = (std::max)(m, row[x]);
+                }
+                *out++ = m;
+            }
+        }
+    }
+
+    struct relu_context {
+        float* data;
+        size_t count;
+        float slope;
+    };
+
+    static const size_t kReluChunk = 4096;
+
+    static void relu_chunk(void* argument, size_t chunk) {
+        const relu_context* ctx = static_cast<const relu_context*>(argument);
+        float* p = ctx->data + chunk*kReluChunk;
+        const size_t n = (std::min)(kReluChunk, ctx->count - chunk*kReluChunk);
+        const v4f zero = v4f_set1(0.0f);
+        const v4f slope = v4f_set1(ctx->slope);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            v4f x = v4f_load(p + i);
+            v4f_store(p + i, v4f_fmadd(slope, v4f_min(x, zero), v4f_max(x, zero)));
+        }
+        for (; i < n; ++i) p[i] = p[i] < 0.0f ? p[i]*ctx->slope : p[i];
+    }
+
+    class NativeBackendImpl : public Backend {
+    public:
+        NativeBackendImpl()
+            :kernel_(kernel_4x8), mr_(4) {
+#ifdef GALAXY_NATIVE_AVX2
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                kernel_ = kernel_8x8_avx2;
+                mr_ = 8;
+            }
+#endif
+        }
+
+        const char* name() const { return mr_ == 8 ? "native-avx2" : "native"; }
+
+        void convolution(const Blob* input, Blob* output, const Blob* w,
+                         const Blob* b, int pad0, int pad1, int stride,
+                         bool relu, Workspace* workspace,
+                         const Blob* transformed_w, threadpool_t threadpool,
+                         nnp_profile* profile) const {
+            const int batch = input->shape(0);
+            const int channels = input->shape(1);
+            const int in_size = channels*input->shape(2)*input->shape(3);
+            const int out_size = output->count()/batch;
+            const int kernel_h = w->shape(2);
+            const int kernel_w = w->shape(3);
+            const bool pointwise = kernel_h == 1 && kernel_w == 1 && stride == 1
+                                   && pad0 == 0 && pad1 == 0;
+            if (profile) memset(profile, 0, sizeof(*profile));
+
+            gemm_context ctx;
+            ctx.m = w->shape(0);
+            ctx.n = output->shape(2)*output->shape(3);
+            ctx.k = channels*kernel_h*kernel_w;
+            ctx.mr = mr_;
+            ctx.kernel = kernel_;
+            ctx.a = w->data();
+            ctx.lda = ctx.k;
+            ctx.b_ks = ctx.n;
+            ctx.b_ns = 1;
+            ctx.c_ms = ctx.n;
+            ctx.c_ns = 1;
+            ctx.bias = b->data();
+            ctx.relu = relu;
+            place_panels(ctx, workspace);
+
+            im2col_view view = {NULL, input->shape(2), input->shape(3), kernel_h, kernel_w,
+                                stride, pad0, output->shape(3)};
+            ctx.view = pointwise ? NULL : &view;
+            for (int i = 0; i < batch; ++i) {
+                ctx.b = input->data() + i*in_size;
+                view.image = ctx.b;
+                ctx.c = output->data() + i*out_size;
+                run_gemm(ctx, threadpool, i == 0);
+            }
+        }
+
+        void max_pooling(const float* input, float* output, int batch,
+                         int channels, int height, int width,
+                         int out_height, int out_width, int size, int stride,
+                         int pad_top, int pad_left, int pad_bottom, int pad_right,
+                         threadpool_t threadpool) const {
+            pool_context ctx = {input, output, height, width, out_height, out_width,
+                                size, stride, pad_top, pad_left};
+            threadpool_compute_1d(threadpool, max_pool_plane, &ctx, size_t(batch*channels));
+        }
+
+        void fully_connected(const float* input, int batch, int input_dim,
+                             int filters, const float* w, float* output,
+                             threadpool_t threadpool, nnp_profile* profile) const {
+            if (profile) memset(profile, 0, sizeof(*profile));
+            if (batch < 4) {
+                gemv_context ctx = {input, batch, input_dim, filters, w, output};
+                threadpool_compute_1d(threadpool, gemv_rows, &ctx, size_t((filters + 15)/16));
+                return;
+            }
+            // output^T (filters, batch) = w (filters, input_dim) * input^T
+            gemm_context ctx;
+            ctx.m = filters;
+            ctx.n = batch;
+            ctx.k = input_dim;
+            ctx.mr = mr_;
+            ctx.kernel = kernel_;
+            ctx.a = w;
+            ctx.lda = input_dim;
+            ctx.b = input;
+            ctx.b_ks = 1;
+            ctx.b_ns = input_dim;
+            ctx.view = NULL;
+            ctx.c = output;
+            ctx.c_ms = 1;
+            ctx.c_ns = filters;
+            ctx.bias = NULL;
+            ctx.relu = false;
+            place_panels(ctx, NULL);
+            run_gemm(ctx, threadpool, true);
+        }
+
+        void softmax(float* data, int batch, int n, threadpool_t threadpool) const {
+            for (int i = -batch; i; ++i, data += n) {
+                float max = *std::max_element(data, data + n);
+                float sum = 0.0f;
+                for (int j = 0; j < n; ++j) {
+                    data[j] = expf(data[j] - max);
+                    sum += data[j];
+                }
+                for (int j = 0; j < n; ++j) data[j] /= sum;
+            }
+        }
+
+        void relu(float* data, int batch, int n, float negative_slope,
+                  threadpool_t threadpool) const {
+            relu_context ctx = {data, size_t(batch)*n, negative_slope};
+            threadpool_compute_1d(threadpool, relu_chunk, &ctx,
+                                  (ctx.count + kReluChunk - 1)/kReluChunk);
+        }
+
+    private:
+        gemm_kernel kernel_;
+        int mr_;
+    };
+
+    const Backend* native_backend() {
+        static NativeBackendImpl instance;
+        return &instance;
+    }
+} //namespace  galaxy
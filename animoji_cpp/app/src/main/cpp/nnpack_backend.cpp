@@ -0,0 +1,215 @@
+#include "backend.hpp"
+
+#ifdef GALAXY_WITH_NNPACK
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "math_functions.hpp"
+
+namespace  galaxy {
+    class NnpackBackendImpl : public Backend {
+    public:
+        NnpackBackendImpl() {
+            enum nnp_status init_status = nnp_initialize();
+            if (init_status != nnp_status_success) {
+                fprintf(stderr, "Initialization failed: error code %d\n", init_status);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        const char* name() const { return "nnpack"; }
+
+        Blob* transform_kernel(const Blob* w) const;
+        void convolution(const Blob* input, Blob* output, const Blob* w,
+                         const Blob* b, int pad0, int pad1, int stride,
+                         bool relu, Workspace* workspace,
+                         const Blob* transformed_w, threadpool_t threadpool,
+                         nnp_profile* profile) const;
+
+        void max_pooling(const float* input, float* output, int batch,
+                         int channels, int height, int width,
+                         int out_height, int out_width, int size, int stride,
+                         int pad_top, int pad_left, int pad_bottom, int pad_right,
+                         threadpool_t threadpool) const {
+            struct nnp_size input_size = {size_t(width), size_t(height)};
+            struct nnp_padding input_padding = {size_t(pad_top), size_t(pad_right),
+                                                size_t(pad_bottom), size_t(pad_left)};
+            struct nnp_size pool_size = {size_t(size), size_t(size)};
+            struct nnp_size pool_stride = {size_t(stride), size_t(stride)};
+            NnpackCall call(threadpool);
+            nnp_max_pooling_output(size_t(batch), size_t(channels), input_size, input_padding,
+                                   pool_size, pool_stride, input, output, call.pool());
+        }
+
+        void fully_connected(const float* input, int batch, int input_dim,
+                             int filters, const float* w, float* output,
+                             threadpool_t threadpool, nnp_profile* profile) const {
+            NnpackCall call(threadpool);
+            if (batch == 1){
+                nnp_fully_connected_inference(size_t(input_dim), size_t(filters),
+                                              input, w, output, call.pool());
+                if (profile) memset(profile, 0, sizeof(*profile));
+            }
+            else{
+                nnp_fully_connected_output(size_t(batch), size_t(input_dim), size_t(filters),
+                                           input, w, output, call.pool(), profile);
+            }
+        }
+
+        void softmax(float* data, int batch, int n, threadpool_t threadpool) const {
+            NnpackCall call(threadpool);
+            nnp_softmax_output(size_t(batch), size_t(n), data, data, call.pool());
+        }
+
+        void relu(float* data, int batch, int n, float negative_slope,
+                  threadpool_t threadpool) const {
+            NnpackCall call(threadpool);
+            nnp_relu_output(size_t(batch), size_t(n), data, data, negative_slope, call.pool());
+        }
+    };
+
+    // Winograd F(6x6, 3x3) kernel transforms of the 3x3 layers, so inference
+    // skips the per-call kernel transform. Kernels NNPACK cannot precompute
+    // for get NULL and use the plain weights.
+    Blob* NnpackBackendImpl::transform_kernel(const Blob* w) const {
+        if (w->num_axes() != 4 || w->shape(2) != 3 || w->shape(3) != 3) return NULL;
+
+        struct nnp_size input_size = {16, 16};
+        struct nnp_padding input_padding = {0, 0, 0, 0};
+        struct nnp_size kernel_size = {3, 3};
+        struct nnp_size stride = {1, 1};
+        size_t size = 0;
+        enum nnp_status status = nnp_convolution_inference(
+                nnp_convolution_algorithm_wt8x8, nnp_convolution_transform_strategy_precompute,
+                size_t(w->shape(1)), size_t(w->shape(0)), input_size, input_padding,
+                kernel_size, stride, NULL, w->data(), NULL, NULL, NULL, &size,
+                nnp_activation_identity, NULL, NULL, NULL);
+        if (status != nnp_status_success || size == 0) return NULL;
+
+        Blob* t = new Blob(int((size + sizeof(float) - 1)/sizeof(float)));
+        size = t->capacity();
+        status = nnp_convolution_inference(
+                nnp_convolution_algorithm_wt8x8, nnp_convolution_transform_strategy_precompute,
+                size_t(w->shape(1)), size_t(w->shape(0)), input_size, input_padding,
+                kernel_size, stride, NULL, w->data(), NULL, NULL, t->data(), &size,
+                nnp_activation_identity, NULL, NULL, NULL);
+        if (status == nnp_status_success) return t;
+        delete t;
+        return NULL;
+    }
+
+    void NnpackBackendImpl::convolution(const Blob* input, Blob* output, const Blob* w,
+                                        const Blob* b, int pad0, int pad1, int stride,
+                                        bool relu, Workspace* workspace,
+                                        const Blob* transformed_w, threadpool_t threadpool,
+                                        nnp_profile* profile) const {
+        Shape input_shape = input->shape();
+        Shape kernel_shape_ = w->shape();
+        int	batch_size = input_shape[0];
+        int	image_channel = input_shape[1];
+        int	image_row = input_shape[2];
+        int	image_col = input_shape[3];
+
+        float* p_top = output->data();
+        float* p_bottom = input->data();
+        float* p_w = w->data();
+        float* p_b = b->data();
+        // one turn for the workspace query and every image
+        NnpackCall call(threadpool);
+        pthreadpool_t pool = call.pool();
+
+        struct nnp_size input_size = {size_t(image_col),size_t(image_row) };
+        struct nnp_padding input_padding = { size_t(pad0),size_t(pad1),size_t(pad1),size_t(pad0)};
+        struct nnp_size kernel_size = { size_t(kernel_shape_[3]), size_t(kernel_shape_[2])};
+        enum nnp_activation activation_ = relu ?
+                                          nnp_activation_relu:
+                                          nnp_activation_identity;
+        bool batched = stride == 1 && batch_size > 3;
+        struct nnp_size stride_ = {size_t(stride), size_t(stride)};
+        // single-image calls reuse the Winograd kernel transform from the Model
+        enum nnp_convolution_algorithm algorithm = nnp_convolution_algorithm_auto;
+        enum nnp_convolution_transform_strategy strategy = nnp_convolution_transform_strategy_tuple_based;
+        const float* p_kernel = p_w;
+        if (transformed_w && stride == 1) {
+            algorithm = nnp_convolution_algorithm_wt8x8;
+            strategy = nnp_convolution_transform_strategy_reuse;
+            p_kernel = transformed_w->data();
+        }
+
+        void* ws_buffer = NULL;
+        size_t ws_size = 0;
+        if (workspace) {
+            if (!workspace->planned) {
+                size_t required = 0;
+                if (batched)
+                    nnp_convolution_output(nnp_convolution_algorithm_auto, size_t(batch_size),
+                                           size_t(image_channel), size_t(kernel_shape_[0]), input_size,
+                                           input_padding, kernel_size, p_bottom,
+                                           p_w, p_b, p_top, NULL, &required, activation_,
+                                           NULL, pool, NULL);
+                else
+                    nnp_convolution_inference(algorithm, strategy,
+                                              size_t(image_channel), size_t(kernel_shape_[0]), input_size,
+                                              input_padding, kernel_size, stride_, p_bottom,
+                                              p_kernel, p_b, p_top, NULL, &required, activation_,
+                                              NULL, pool, NULL);
+                workspace->reserve(required);
+            }
+            ws_buffer = workspace->data;
+            ws_size = workspace->size;
+        }
+        // a NULL buffer with a size pointer would only query the size
+        size_t* ws_size_ptr = ws_buffer ? &ws_size : NULL;
+
+        if (batch_size == 1){
+            nnp_convolution_inference(algorithm, strategy,
+                                      size_t(image_channel), size_t(kernel_shape_[0]), input_size,
+                                      input_padding, kernel_size, stride_, p_bottom,
+                                      p_kernel, p_b, p_top, ws_buffer, ws_size_ptr, activation_,
+                                      NULL, pool, profile);
+        }
+        else{
+            if (batched){
+                nnp_convolution_output(nnp_convolution_algorithm_auto, size_t(batch_size),
+                                       size_t(image_channel), size_t(kernel_shape_[0]), input_size,
+                                       input_padding, kernel_size, p_bottom,
+                                       p_w, p_b, p_top, ws_buffer, ws_size_ptr, activation_,
+                                       NULL, pool, profile);
+            }
+            else{
+                int nb = input->count()/batch_size;
+                int nt = output->count()/batch_size;
+                struct nnp_profile image_profile;
+                if (profile) memset(profile, 0, sizeof(*profile));
+                for(int i = -batch_size; i; ++i){
+                    nnp_convolution_inference(algorithm, strategy,
+                                              size_t(image_channel), size_t(kernel_shape_[0]), input_size,
+                                              input_padding, kernel_size, stride_, p_bottom,
+                                              p_kernel, p_b, p_top, ws_buffer, ws_size_ptr, activation_,
+                                              NULL, pool, profile ? &image_profile : NULL);
+                    if (profile) {
+                        profile->total += image_profile.total;
+                        profile->input_transform += image_profile.input_transform;
+                        profile->kernel_transform += image_profile.kernel_transform;
+                        profile->output_transform += image_profile.output_transform;
+                        profile->block_multiplication += image_profile.block_multiplication;
+                    }
+                    p_bottom += nb;
+                    p_top += nt;
+                }
+            }
+        }
+    }
+
+    const Backend* nnpack_backend() {
+        static NnpackBackendImpl instance;
+        return &instance;
+    }
+} //namespace  galaxy
+#else
+namespace  galaxy {
+    const Backend* nnpack_backend() {
+        return NULL;
+    }
+} //namespace  galaxy
+#endif //GALAXY_WITH_NNPACK
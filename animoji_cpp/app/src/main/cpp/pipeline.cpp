@@ -0,0 +1,180 @@
+#include <string.h>
+#include "pipeline.hpp"
+
+using namespace std::chrono;
+namespace  galaxy {
+    // a single-thread stage runs its parallel regions inline
+    static threadpool_t create_pool(int threads) {
+        return threads > 1 ? create_threadpool(threads, PoolOptions()) : NULL;
+    }
+
+    Pipeline::Pipeline(const std::string& model_path, int preprocess_threads,
+                       int detect_threads, int landmark_threads, int queue_depth)
+        :net_(detect_threads), next_id_(0),
+         preprocess_queue_(queue_depth), detect_queue_(queue_depth),
+         landmark_queue_(queue_depth), output_queue_(queue_depth),
+         free_inputs_(queue_depth + 2) {
+        net_.load_weight(model_path);
+        preprocess_pool_ = create_pool(preprocess_threads);
+        net_.context().set_landmark_threads(landmark_threads);
+        // one being filled, queue_depth waiting, one being detected
+        for (int i = queue_depth + 2; i; --i) {
+            inputs_.push_back(new Blob(1, 3, 16, 16));
+            free_inputs_.push(inputs_.back());
+        }
+        threads_.push_back(std::thread(&Pipeline::preprocess_loop, this));
+        threads_.push_back(std::thread(&Pipeline::detect_loop, this));
+        threads_.push_back(std::thread(&Pipeline::landmark_loop, this));
+    }
+
+    bool Pipeline::push(Frame* frame, bool wait) {
+        const InferenceContext& ctx = net_.context_;
+        if (ctx.keyframe_interval_ > 1 || ctx.speculative_ || ctx.deadline_ms_ > 0) {
+            delete frame;
+            return false;
+        }
+        frame->id = next_id_;
+        frame->input = NULL;
+        frame->pushed = high_resolution_clock::now();
+        if (wait ? preprocess_queue_.push(frame) : preprocess_queue_.try_push(frame)) {
+            next_id_++;
+            return true;
+        }
+        delete frame;
+        return false;
+    }
+
+    bool Pipeline::push(const cv::Mat& im) {
+        Frame* frame = new Frame;
+        frame->mat = im;
+        frame->view = make_view(im);
+        return push(frame, true);
+    }
+
+    bool Pipeline::push(const ImageView& im) {
+        Frame* frame = new Frame;
+        frame->view = im;
+        return push(frame, true);
+    }
+
+    bool Pipeline::try_push(const cv::Mat& im) {
+        Frame* frame = new Frame;
+        frame->mat = im;
+        frame->view = make_view(im);
+        return push(frame, false);
+    }
+
+    bool Pipeline::try_push(const ImageView& im) {
+        Frame* frame = new Frame;
+        frame->view = im;
+        return push(frame, false);
+    }
+
+    bool Pipeline::pop(PipelineResult& result) {
+        Frame* frame;
+        if (!output_queue_.pop(frame)) return false;
+        result.frame_id = frame->id;
+        result.faces.swap(frame->faces);
+        result.dropped_faces = frame->dropped_faces;
+        result.latency = (float)duration_cast<microseconds>(
+                high_resolution_clock::now() - frame->pushed).count()*1e-3;
+        delete frame;
+        return true;
+    }
+
+    void Pipeline::close() {
+        preprocess_queue_.close();
+    }
+
+    void Pipeline::preprocess_loop() {
+        Frame* frame;
+        while (preprocess_queue_.pop(frame)) {
+            const ImageView& im = frame->view;
+            frame->layout = net_.context_.input_layout(im.width, im.height);
+            const InputLayout& layout = frame->layout;
+            if (!free_inputs_.pop(frame->input)) {
+                delete frame;
+                break;
+            }
+            {
+                // queue waits stay outside the event, so stalls show as gaps
+                TraceScope trace(net_.context_.tracer_, "preprocess", "pipeline");
+                frame->input->reshape({1, 3, layout.net_height, layout.net_width});
+                if (layout.width != layout.net_width || layout.height != layout.net_height)
+                    memset(frame->input->data(), 0, frame->input->count()*sizeof(float));
+                if (!frame->mat.empty())
+                    net_.fill_input(frame->mat, frame->input, layout, preprocess_pool_);
+                else
+                    net_.fill_input(im, frame->input, layout, preprocess_pool_);
+            }
+            if (!detect_queue_.push(frame)) {
+                delete frame;
+                break;
+            }
+        }
+        detect_queue_.close();
+    }
+
+    void Pipeline::detect_loop() {
+        Frame* frame;
+        while (detect_queue_.pop(frame)) {
+            {
+                TraceScope trace(net_.context_.tracer_, "detect", "pipeline");
+                const InputLayout& layout = frame->layout;
+                DetectPlan* plan = net_.get_plan(net_.context_, layout.net_width, layout.net_height);
+                net_.context_.stats_.detect_layers.clear();
+                net_.forward(frame->input, plan, net_.context_.threadpool(), &net_.context_);
+                frame->faces = net_.decode(plan, layout, frame->view.width, frame->view.height, 0,
+                                           net_.context_.nms_max_keep(), &frame->dropped_faces);
+                frame->dropped_faces += net_.context_.select_faces(frame->faces);
+            }
+            free_inputs_.push(frame->input);
+            frame->input = NULL;
+            if (!landmark_queue_.push(frame)) {
+                delete frame;
+                break;
+            }
+        }
+        landmark_queue_.close();
+    }
+
+    void Pipeline::landmark_loop() {
+        Frame* frame;
+        while (landmark_queue_.pop(frame)) {
+            net_.context_.stats_.landmark_layers.clear();
+            if (!frame->faces.empty()) {
+                TraceScope trace(net_.context_.tracer_, "landmark", "pipeline");
+                if (!frame->mat.empty())
+                    net_.landmarknet_.predict(frame->mat, frame->faces, net_.context_);
+                else
+                    net_.landmarknet_.predict(frame->view, frame->faces, net_.context_);
+            }
+            if (!output_queue_.push(frame)) {
+                delete frame;
+                break;
+            }
+        }
+        output_queue_.close();
+    }
+
+    Pipeline::~Pipeline() {
+        // abandon frames still in flight
+        preprocess_queue_.close();
+        detect_queue_.close();
+        landmark_queue_.close();
+        output_queue_.close();
+        free_inputs_.close();
+        for (size_t i = 0; i < threads_.size(); ++i) {
+            threads_[i].join();
+        }
+        Frame* frame;
+        while (preprocess_queue_.pop(frame)) delete frame;
+        while (detect_queue_.pop(frame)) delete frame;
+        while (landmark_queue_.pop(frame)) delete frame;
+        while (output_queue_.pop(frame)) delete frame;
+        for (size_t i = 0; i < inputs_.size(); ++i) {
+            delete inputs_[i];
+        }
+        if (preprocess_pool_) threadpool_destroy(preprocess_pool_);
+    }
+} //namespace  galaxy
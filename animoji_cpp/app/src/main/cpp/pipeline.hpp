@@ -0,0 +1,138 @@
+#ifndef PIPELINE_HPP_
+#define PIPELINE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "blob.hpp"
+#include "detection.hpp"
+#include "image_utils.hpp"
+
+namespace  galaxy {
+    // Fixed-capacity FIFO shared by two stage threads. push blocks while the
+    // queue is full (try_push fails instead) and pop while it is empty; after
+    // close() pushes fail and pop drains what is left, then returns false.
+    template <typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity): capacity_(capacity), closed_(false) {}
+
+        bool push(const T& item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock, [this]{ return closed_ || items_.size() < capacity_; });
+            if (closed_) return false;
+            items_.push_back(item);
+            not_empty_.notify_one();
+            return true;
+        }
+
+        bool try_push(const T& item) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_ || items_.size() >= capacity_) return false;
+            items_.push_back(item);
+            not_empty_.notify_one();
+            return true;
+        }
+
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [this]{ return closed_ || !items_.empty(); });
+            if (items_.empty()) return false;
+            item = items_.front();
+            items_.pop_front();
+            not_full_.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            not_full_.notify_all();
+            not_empty_.notify_all();
+        }
+
+    private:
+        size_t capacity_;
+        bool closed_;
+        std::deque<T> items_;
+        std::mutex mutex_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+    };
+
+    struct PipelineResult {
+        int frame_id;
+        std::vector<bbox> faces;
+        float latency;      // ms from push() to the end of the landmark stage
+        int dropped_faces;  // left out by the face budget
+    };
+
+    // Streams frames through preprocess -> detect (forward, decode, NMS) ->
+    // landmark, each stage on its own thread with its own thread pool, so
+    // frame N+1 is preprocessed while frame N is detected and frame N-1 gets
+    // landmarks. queue_depth bounds the frames waiting between two stages and
+    // therefore the per-frame latency.
+    class Pipeline {
+    public:
+        Pipeline(const std::string& model_path, int preprocess_threads = 1,
+                 int detect_threads = -1, int landmark_threads = 1,
+                 int queue_depth = 2);
+        ~Pipeline();
+
+        // Configure before the first push; the stages read it concurrently.
+        // Every frame runs the detector and gets its own landmarks, so
+        // tracking, speculative landmarks and deadline mode are not
+        // supported: push rejects frames while one of them is on.
+        DetectNet& net() { return net_; }
+
+        // Frames get ids in push order. A pushed frame's pixels must stay
+        // unchanged until its result has been popped. false when closed, or
+        // when net() has an unsupported setting on; no id is used then.
+        // push blocks once every queue is full, i.e. when queue_depth
+        // results wait unpopped; a thread that pushes and pops must use
+        // try_push, which returns false instead, then pop a result.
+        bool push(const cv::Mat& im);
+        bool push(const ImageView& im);
+        bool try_push(const cv::Mat& im);
+        bool try_push(const ImageView& im);
+        // Results come out in push order; false once closed and drained.
+        bool pop(PipelineResult& result);
+        // Stops accepting frames; frames already pushed still complete.
+        void close();
+
+    private:
+        struct Frame {
+            int id;
+            cv::Mat mat;
+            ImageView view;
+            InputLayout layout;
+            Blob* input;
+            std::vector<bbox> faces;
+            int dropped_faces;
+            std::chrono::high_resolution_clock::time_point pushed;
+        };
+
+        bool push(Frame* frame, bool wait);
+        void preprocess_loop();
+        void detect_loop();
+        void landmark_loop();
+
+        DetectNet net_;
+        threadpool_t preprocess_pool_;
+        int next_id_;
+        BoundedQueue<Frame*> preprocess_queue_;
+        BoundedQueue<Frame*> detect_queue_;
+        BoundedQueue<Frame*> landmark_queue_;
+        BoundedQueue<Frame*> output_queue_;
+        // recycled detector input blobs, one per frame that can be in flight
+        BoundedQueue<Blob*> free_inputs_;
+        std::vector<Blob*> inputs_;
+        std::vector<std::thread> threads_;
+    };
+} //namespace  galaxy
+#endif //PIPELINE_HPP_
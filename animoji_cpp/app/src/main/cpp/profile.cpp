@@ -0,0 +1,36 @@
+#include <string.h>
+#include "profile.hpp"
+
+using namespace std::chrono;
+namespace  galaxy {
+    LayerProfiler::LayerProfiler(std::vector<LayerStats>* layers, Tracer* tracer,
+                                 const char* category, bool capture)
+        :layers_(layers), tracer_(tracer), category_(category), capture_(capture){
+        if (!layers_ && !tracer_) return;
+        memset(&profile_, 0, sizeof(profile_));
+        start_ = Tracer::clock::now();
+    }
+
+    void LayerProfiler::record(const char* op, const Blob* input, const Blob* output){
+        if (!layers_ && !tracer_) return;
+        Tracer::clock::time_point end = Tracer::clock::now();
+        if (tracer_) tracer_->record(op, category_, start_, end);
+        if (!layers_) {
+            start_ = end;
+            return;
+        }
+        LayerStats layer;
+        layer.op = op;
+        layer.input_shape = input->shape();
+        layer.output_shape = output->shape();
+        layer.time = (float)duration_cast<microseconds>(end - start_).count()*1e-3;
+        layer.input_transform = (float)(profile_.input_transform*1e3);
+        layer.kernel_transform = (float)(profile_.kernel_transform*1e3);
+        layer.output_transform = (float)(profile_.output_transform*1e3);
+        layer.block_multiplication = (float)(profile_.block_multiplication*1e3);
+        if (capture_) layer.output.assign(output->data(), output->data() + output->count());
+        layers_->push_back(layer);
+        memset(&profile_, 0, sizeof(profile_));
+        start_ = Tracer::clock::now();
+    }
+} //namespace  galaxy
@@ -0,0 +1,69 @@
+#ifndef PROFILE_HPP_
+#define PROFILE_HPP_
+
+#include <chrono>
+#include <vector>
+#include <nnpack.h>
+#include "blob.hpp"
+#include "trace.hpp"
+
+namespace  galaxy {
+    // One op of one forward pass. Times are in ms; the NNPACK phases stay
+    // zero for ops NNPACK does not profile (pooling, activations, 1-image FC)
+    // and under the native backend.
+    struct LayerStats {
+        const char* op;
+        Shape input_shape;
+        Shape output_shape;
+        float time;
+        float input_transform;
+        float kernel_transform;
+        float output_transform;
+        float block_multiplication;
+        // copy of the output tensor, only when outputs are captured
+        std::vector<float> output;
+    };
+
+    // Timings of the last predict() on a context, in ms. detect_time spans
+    // preprocess, forward and decode (incl. NMS); all four are zero on
+    // tracked frames. The layer lists are only filled with profiling enabled;
+    // landmark_layers holds every LandmarkNet pass of the call in order.
+    struct InferenceStats {
+        InferenceStats(): detect_time(0), preprocess_time(0), forward_time(0),
+                          decode_time(0), landmark_time(0), dropped_faces(0),
+                          quality_level(-1) {}
+
+        float detect_time;
+        float preprocess_time;
+        float forward_time;
+        float decode_time;
+        float landmark_time;
+        // faces left out by the face budget, see set_max_faces
+        int dropped_faces;
+        // deadline mode level the call ran at, -1 when the mode is off
+        int quality_level;
+        std::vector<LayerStats> detect_layers;
+        std::vector<LayerStats> landmark_layers;
+    };
+
+    // Records the ops of one forward pass into layers and, as events of
+    // category, into tracer. Each record() closes the op that ran since the
+    // previous record(); with both NULL it only costs a branch.
+    class LayerProfiler {
+    public:
+        LayerProfiler(std::vector<LayerStats>* layers, Tracer* tracer = NULL,
+                      const char* category = "", bool capture = false);
+        // profile for the next NNPACK call, NULL when disabled
+        nnp_profile* nnpack() { return layers_ ? &profile_ : NULL; }
+        void record(const char* op, const Blob* input, const Blob* output);
+
+    private:
+        std::vector<LayerStats>* layers_;
+        Tracer* tracer_;
+        const char* category_;
+        bool capture_;
+        nnp_profile profile_;
+        Tracer::clock::time_point start_;
+    };
+} //namespace  galaxy
+#endif //PROFILE_HPP_
@@ -0,0 +1,133 @@
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GALAXY_SIMD_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GALAXY_SIMD_SSE2
+#endif
+
+// Four-lane float helpers shared by the hand-written kernels. Each target
+// gets the same small vocabulary so kernel code stays free of intrinsics.
+namespace  galaxy {
+#if defined(GALAXY_SIMD_NEON)
+    typedef float32x4_t v4f;
+
+    inline v4f v4f_load(const float* p) { return vld1q_f32(p); }
+    inline void v4f_store(float* p, v4f a) { vst1q_f32(p, a); }
+    inline v4f v4f_set1(float a) { return vdupq_n_f32(a); }
+    inline v4f v4f_add(v4f a, v4f b) { return vaddq_f32(a, b); }
+    inline v4f v4f_sub(v4f a, v4f b) { return vsubq_f32(a, b); }
+    inline v4f v4f_mul(v4f a, v4f b) { return vmulq_f32(a, b); }
+    inline v4f v4f_fmadd(v4f a, v4f b, v4f c) { return vmlaq_f32(c, a, b); }
+    inline v4f v4f_max(v4f a, v4f b) { return vmaxq_f32(a, b); }
+    inline v4f v4f_min(v4f a, v4f b) { return vminq_f32(a, b); }
+    inline v4f v4f_div(v4f a, v4f b) {
+        v4f r = vrecpeq_f32(b);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        return vmulq_f32(a, r);
+    }
+    inline v4f v4f_floor(v4f a) {
+        v4f t = vcvtq_f32_s32(vcvtq_s32_f32(a));
+        uint32x4_t gt = vcgtq_f32(t, a);
+        return vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(gt,
+                             vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+    }
+    // 2^n for integral n in [-126, 127]
+    inline v4f v4f_pow2i(v4f n) {
+        int32x4_t e = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+        return vreinterpretq_f32_s32(e);
+    }
+    // bit i of the result is set when a[i] > b[i]
+    inline int v4f_gt_mask(v4f a, v4f b) {
+        static const uint32_t bits[4] = {1, 2, 4, 8};
+        uint32x4_t m = vandq_u32(vcgtq_f32(a, b), vld1q_u32(bits));
+        uint32x2_t s = vadd_u32(vget_low_u32(m), vget_high_u32(m));
+        return static_cast<int>(vget_lane_u32(vpadd_u32(s, s), 0));
+    }
+#elif defined(GALAXY_SIMD_SSE2)
+    typedef __m128 v4f;
+
+    inline v4f v4f_load(const float* p) { return _mm_loadu_ps(p); }
+    inline void v4f_store(float* p, v4f a) { _mm_storeu_ps(p, a); }
+    inline v4f v4f_set1(float a) { return _mm_set1_ps(a); }
+    inline v4f v4f_add(v4f a, v4f b) { return _mm_add_ps(a, b); }
+    inline v4f v4f_sub(v4f a, v4f b) { return _mm_sub_ps(a, b); }
+    inline v4f v4f_mul(v4f a, v4f b) { return _mm_mul_ps(a, b); }
+    inline v4f v4f_fmadd(v4f a, v4f b, v4f c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline v4f v4f_max(v4f a, v4f b) { return _mm_max_ps(a, b); }
+    inline v4f v4f_min(v4f a, v4f b) { return _mm_min_ps(a, b); }
+    inline v4f v4f_div(v4f a, v4f b) { return _mm_div_ps(a, b); }
+    inline v4f v4f_floor(v4f a) {
+        v4f t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    }
+    inline v4f v4f_pow2i(v4f n) {
+        __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+        return _mm_castsi128_ps(e);
+    }
+    inline int v4f_gt_mask(v4f a, v4f b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+#else
+    struct v4f { float v[4]; };
+
+    inline v4f v4f_load(const float* p) { v4f r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    inline void v4f_store(float* p, v4f a) { memcpy(p, a.v, sizeof(a.v)); }
+    inline v4f v4f_set1(float a) { v4f r = {{a, a, a, a}}; return r; }
+#define GALAXY_V4F_BINARY(name, expr) \
+    inline v4f name(v4f a, v4f b) { \
+        v4f r; for (int i = 0; i < 4; ++i) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } \
+        return r; }
+    GALAXY_V4F_BINARY(v4f_add, x + y)
+    GALAXY_V4F_BINARY(v4f_sub, x - y)
+    GALAXY_V4F_BINARY(v4f_mul, x * y)
+    GALAXY_V4F_BINARY(v4f_max, x > y ? x : y)
+    GALAXY_V4F_BINARY(v4f_min, x < y ? x : y)
+    GALAXY_V4F_BINARY(v4f_div, x / y)
+#undef GALAXY_V4F_BINARY
+    inline v4f v4f_fmadd(v4f a, v4f b, v4f c) { return v4f_add(v4f_mul(a, b), c); }
+    inline v4f v4f_floor(v4f a) {
+        for (int i = 0; i < 4; ++i) a.v[i] = floorf(a.v[i]);
+        return a;
+    }
+    inline v4f v4f_pow2i(v4f n) {
+        for (int i = 0; i < 4; ++i) n.v[i] = ldexpf(1.0f, static_cast<int>(n.v[i]));
+        return n;
+    }
+    inline int v4f_gt_mask(v4f a, v4f b) {
+        int m = 0;
+        for (int i = 0; i < 4; ++i) m |= (a.v[i] > b.v[i]) << i;
+        return m;
+    }
+#endif
+
+    // Cephes-style exp: range reduction by ln2 and a degree-5 polynomial,
+    // about 1 ulp over the clamped input range.
+    inline v4f v4f_exp(v4f x) {
+        x = v4f_min(x, v4f_set1(88.0f));
+        x = v4f_max(x, v4f_set1(-87.3365478515625f));
+        v4f fx = v4f_floor(v4f_fmadd(x, v4f_set1(1.44269504088896341f), v4f_set1(0.5f)));
+        x = v4f_sub(x, v4f_mul(fx, v4f_set1(0.693359375f)));
+        x = v4f_sub(x, v4f_mul(fx, v4f_set1(-2.12194440e-4f)));
+        v4f y = v4f_set1(1.9875691500E-4f);
+        y = v4f_fmadd(y, x, v4f_set1(1.3981999507E-3f));
+        y = v4f_fmadd(y, x, v4f_set1(8.3334519073E-3f));
+        y = v4f_fmadd(y, x, v4f_set1(4.1665795894E-2f));
+        y = v4f_fmadd(y, x, v4f_set1(1.6666665459E-1f));
+        y = v4f_fmadd(y, x, v4f_set1(5.0000001201E-1f));
+        y = v4f_fmadd(y, v4f_mul(x, x), v4f_add(x, v4f_set1(1.0f)));
+        return v4f_mul(y, v4f_pow2i(fx));
+    }
+
+    inline v4f v4f_sigmoid(v4f x) {
+        v4f one = v4f_set1(1.0f);
+        return v4f_div(one, v4f_add(one, v4f_exp(v4f_sub(v4f_set1(0.0f), x))));
+    }
+} //namespace  galaxy
+#endif //SIMD_HPP_
@@ -0,0 +1,161 @@
+#include <assert.h>
+#include <algorithm>
+#include "simd.hpp"
+#include "sparse.hpp"
+
+namespace  galaxy {
+    SparseWeights::SparseWeights(int rows, int cols)
+        :rows_(rows), cols_(cols), block_start_(1, 0){
+    }
+
+    SparseWeights* SparseWeights::compress(const Blob* w, float max_density) {
+        if (w->num_axes() == 4 && (w->shape(2) != 1 || w->shape(3) != 1)) return NULL;
+        if (w->num_axes() != 2 && w->num_axes() != 4) return NULL;
+        const int rows = w->shape(0);
+        const int cols = w->count()/rows;
+        const float* data = w->data();
+        const int groups = (rows + 3)/4;
+
+        int blocks = 0;
+        for (int g = 0; g < groups; ++g) {
+            for (int c = 0; c < cols; ++c) {
+                for (int r = 4*g; r < (std::min)(4*g + 4, rows); ++r) {
+                    if (data[r*cols + c] != 0.0f) {
+                        blocks++;
+                        break;
+                    }
+                }
+            }
+        }
+        if (blocks > max_density*groups*cols) return NULL;
+
+        SparseWeights* s = new SparseWeights(rows, cols);
+        s->block_col_.reserve(blocks);
+        s->block_value_.reserve(4*blocks);
+        for (int g = 0; g < groups; ++g) {
+            for (int c = 0; c < cols; ++c) {
+                float v[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                bool nonzero = false;
+                for (int r = 4*g; r < (std::min)(4*g + 4, rows); ++r) {
+                    v[r - 4*g] = data[r*cols + c];
+                    nonzero = nonzero || v[r - 4*g] != 0.0f;
+                }
+                if (!nonzero) continue;
+                s->block_col_.push_back(c);
+                s->block_value_.insert(s->block_value_.end(), v, v + 4);
+            }
+            s->block_start_.push_back(static_cast<int>(s->block_col_.size()));
+        }
+        return s;
+    }
+
+    float SparseWeights::density() const {
+        int groups = (rows_ + 3)/4;
+        return static_cast<float>(block_col_.size())/(groups*cols_);
+    }
+
+    struct sparse_context {
+        const int* start;
+        const int* col;
+        const float* value;
+        int rows;
+        int cols;
+        const float* input;
+        int n;      // batch rows for FC, pixels for 1x1 conv
+        const float* bias;
+        float* output;
+    };
+
+    static v4f group_bias(const sparse_context* ctx, int r0) {
+        float b[4];
+        for (int l = 0; l < 4; ++l) b[l] = r0 + l < ctx->rows ? ctx->bias[r0 + l] : 0.0f;
+        return v4f_load(b);
+    }
+
+    // 4 outputs of a group for up to 4 batch rows at a time, so every block
+    // is loaded once per 4 rows
+    static void fc_group(void* argument, size_t g) {
+        const sparse_context* ctx = static_cast<const sparse_context*>(argument);
+        const int r0 = 4*static_cast<int>(g);
+        const int begin = ctx->start[g];
+        const int end = ctx->start[g + 1];
+        const v4f bias = group_bias(ctx, r0);
+        for (int n = 0; n < ctx->n; n += 4) {
+            const int nb = (std::min)(4, ctx->n - n);
+            const float* x[4];
+            for (int l = 0; l < 4; ++l) {
+                x[l] = ctx->input + (n + (std::min)(l, nb - 1))*ctx->cols;
+            }
+            v4f acc[4] = {bias, bias, bias, bias};
+            for (int k = begin; k < end; ++k) {
+                const v4f v = v4f_load(ctx->value + 4*k);
+                const int c = ctx->col[k];
+                acc[0] = v4f_fmadd(v, v4f_set1(x[0][c]), acc[0]);
+                acc[1] = v4f_fmadd(v, v4f_set1(x[1][c]), acc[1]);
+                acc[2] = v4f_fmadd(v, v4f_set1(x[2][c]), acc[2]);
+                acc[3] = v4f_fmadd(v, v4f_set1(x[3][c]), acc[3]);
+            }
+            for (int l = 0; l < nb; ++l) {
+                float* out = ctx->output + (n + l)*ctx->rows + r0;
+                if (r0 + 4 <= ctx->rows) {
+                    v4f_store(out, acc[l]);
+                } else {
+                    float tmp[4];
+                    v4f_store(tmp, acc[l]);
+                    for (int r = 0; r < ctx->rows - r0; ++r) out[r] = tmp[r];
+                }
+            }
+        }
+    }
+
+    // 4 output planes of a group, 4 pixels at a time
+    static void conv1x1_group(void* argument, size_t g) {
+        const sparse_context* ctx = static_cast<const sparse_context*>(argument);
+        const int r0 = 4*static_cast<int>(g);
+        const int rows = (std::min)(4, ctx->rows - r0);
+        const int begin = ctx->start[g];
+        const int end = ctx->start[g + 1];
+        const int size = ctx->n;
+        float b[4];
+        for (int l = 0; l < 4; ++l) b[l] = l < rows ? ctx->bias[r0 + l] : 0.0f;
+        float* out = ctx->output + r0*size;
+        int p = 0;
+        for (; p + 4 <= size; p += 4) {
+            v4f acc[4] = {v4f_set1(b[0]), v4f_set1(b[1]), v4f_set1(b[2]), v4f_set1(b[3])};
+            for (int k = begin; k < end; ++k) {
+                const float* v = ctx->value + 4*k;
+                const v4f x = v4f_load(ctx->input + ctx->col[k]*size + p);
+                acc[0] = v4f_fmadd(v4f_set1(v[0]), x, acc[0]);
+                acc[1] = v4f_fmadd(v4f_set1(v[1]), x, acc[1]);
+                acc[2] = v4f_fmadd(v4f_set1(v[2]), x, acc[2]);
+                acc[3] = v4f_fmadd(v4f_set1(v[3]), x, acc[3]);
+            }
+            for (int l = 0; l < rows; ++l) v4f_store(out + l*size + p, acc[l]);
+        }
+        for (; p < size; ++p) {
+            float acc[4] = {b[0], b[1], b[2], b[3]};
+            for (int k = begin; k < end; ++k) {
+                const float* v = ctx->value + 4*k;
+                const float x = ctx->input[ctx->col[k]*size + p];
+                for (int l = 0; l < 4; ++l) acc[l] += v[l]*x;
+            }
+            for (int l = 0; l < rows; ++l) out[l*size + p] = acc[l];
+        }
+    }
+
+    void SparseWeights::fully_connected(const float* input, int batch, const float* bias,
+                                        float* output, threadpool_t threadpool) const {
+        sparse_context ctx = {&block_start_[0], block_col_.empty() ? NULL : &block_col_[0],
+                              block_value_.empty() ? NULL : &block_value_[0],
+                              rows_, cols_, input, batch, bias, output};
+        threadpool_compute_1d(threadpool, fc_group, &ctx, block_start_.size() - 1);
+    }
+
+    void SparseWeights::conv1x1(const float* input, int size, const float* bias,
+                                float* output, threadpool_t threadpool) const {
+        sparse_context ctx = {&block_start_[0], block_col_.empty() ? NULL : &block_col_[0],
+                              block_value_.empty() ? NULL : &block_value_[0],
+                              rows_, cols_, input, size, bias, output};
+        threadpool_compute_1d(threadpool, conv1x1_group, &ctx, block_start_.size() - 1);
+    }
+} //namespace  galaxy
@@ -0,0 +1,50 @@
+#ifndef SPARSE_HPP_
+#define SPARSE_HPP_
+
+#include <vector>
+#include "blob.hpp"
+#include "threadpool.hpp"
+
+namespace  galaxy {
+    // Block share above which the dense kernels stay faster, from the
+    // op_benchmark sparse rows (native backend, x86_64, one thread): the
+    // 256x1152 FC at batch 1 breaks even at 0.3-0.4, batch 4 and the
+    // detector's 1x1 layers at 0.6 and above. Re-run them on the device.
+    const float kSparseMaxDensity = 0.3f;
+
+    // FC and 1x1 convolution weights in block-compressed sparse row form:
+    // blocks of 4 outputs x 1 input, kept when any of their four weights is
+    // nonzero. Pruned models store their zeros in the plain weight file, so
+    // the Model compresses those layers at load time.
+    class SparseWeights {
+    public:
+        // NULL when w is not an FC or 1x1 kernel, or when more than
+        // max_density of its blocks hold a nonzero weight.
+        static SparseWeights* compress(const Blob* w, float max_density = kSparseMaxDensity);
+
+        int rows() const { return rows_; }
+        int cols() const { return cols_; }
+        // share of the blocks that are stored
+        float density() const;
+
+        // output (batch, rows) = input (batch, cols) * w^T + bias
+        void fully_connected(const float* input, int batch, const float* bias,
+                             float* output, threadpool_t threadpool) const;
+        // output (rows, size) = w * input (cols, size) + bias, i.e. one
+        // image of a 1x1 convolution with size pixels
+        void conv1x1(const float* input, int size, const float* bias,
+                     float* output, threadpool_t threadpool) const;
+
+    private:
+        SparseWeights(int rows, int cols);
+
+        int rows_;
+        int cols_;
+        // first block of each group of 4 rows, plus the end
+        std::vector<int> block_start_;
+        std::vector<int> block_col_;
+        // 4 weights per block; rows past rows_ are zero
+        std::vector<float> block_value_;
+    };
+} //namespace  galaxy
+#endif //SPARSE_HPP_
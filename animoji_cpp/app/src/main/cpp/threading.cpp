@@ -0,0 +1,183 @@
+#include <sched.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "threading.hpp"
+
+namespace  galaxy {
+    // below this many multiply-adds (or elements) an op runs inline, and
+    // every thread should get at least this much work
+    static const double kWorkPerThread = 32768.0;
+
+    bool takes_pool(const LayerStats& op) {
+        return strcmp(op.op, "prelu") != 0 && strcmp(op.op, "compact") != 0;
+    }
+
+    // multiply-adds for conv / fc, touched elements otherwise; the kernel
+    // area is not recorded, so convolutions are underestimated by k*k
+    static double op_work(const LayerStats& op) {
+        double outputs = 1.0;
+        for (size_t i = 0; i < op.output_shape.size(); ++i) outputs *= op.output_shape[i];
+        if (strcmp(op.op, "conv") == 0 || strcmp(op.op, "fc") == 0)
+            return outputs*op.input_shape[1];
+        return outputs;
+    }
+
+    std::vector<int> cost_model_threads(const std::vector<LayerStats>& ops,
+                                        int max_threads, bool inline_small) {
+        std::vector<int> threads;
+        for (size_t i = 0; i < ops.size(); ++i) {
+            if (!takes_pool(ops[i])) continue;
+            double work = op_work(ops[i]);
+            int n = static_cast<int>(work/kWorkPerThread);
+            int least = inline_small ? 1 : (std::min)(2, max_threads);
+            threads.push_back((std::max)(least, (std::min)(max_threads, n)));
+        }
+        return threads;
+    }
+
+    std::vector<int> calibrate_threads(const std::vector<int>& candidates, int repeats,
+                                       const std::function<void(int, std::vector<LayerStats>*)>& run) {
+        std::vector<int> best;
+        std::vector<float> best_time;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            std::vector<std::vector<float> > samples;
+            for (int r = 0; r < repeats; ++r) {
+                std::vector<LayerStats> ops;
+                run(candidates[c], &ops);
+                std::vector<float> times;
+                for (size_t i = 0; i < ops.size(); ++i) {
+                    if (takes_pool(ops[i])) times.push_back(ops[i].time);
+                }
+                samples.resize(times.size());
+                for (size_t i = 0; i < times.size(); ++i) samples[i].push_back(times[i]);
+            }
+            if (best.empty()) {
+                best.assign(samples.size(), candidates[c]);
+                best_time.assign(samples.size(), 1e30f);
+            }
+            for (size_t i = 0; i < samples.size() && i < best.size(); ++i) {
+                std::vector<float>& s = samples[i];
+                std::nth_element(s.begin(), s.begin() + s.size()/2, s.end());
+                if (s[s.size()/2] < best_time[i]) {
+                    best_time[i] = s[s.size()/2];
+                    best[i] = candidates[c];
+                }
+            }
+        }
+        return best;
+    }
+
+    std::vector<int> thread_candidates(int max_threads) {
+        std::vector<int> candidates;
+        for (int n = 1; n < max_threads; n *= 2) candidates.push_back(n);
+        candidates.push_back((std::max)(1, max_threads));
+        return candidates;
+    }
+
+    Worker::Worker(): busy_(false), stop_(false) {
+        thread_ = std::thread(&Worker::loop, this);
+    }
+
+    Worker::~Worker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void Worker::start(const std::function<void()>& job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = job;
+        busy_ = true;
+        cond_.notify_all();
+    }
+
+    void Worker::wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]{ return !busy_; });
+    }
+
+    void Worker::loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cond_.wait(lock, [this]{ return busy_ || stop_; });
+            if (!busy_) return;
+            lock.unlock();
+            job_();
+            lock.lock();
+            busy_ = false;
+            cond_.notify_all();
+        }
+    }
+
+    bool pin_current_thread(const std::vector<int>& cpus) {
+#if defined(__linux__) || defined(__ANDROID__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (size_t i = 0; i < cpus.size(); ++i) CPU_SET(cpus[i], &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    struct pin_context {
+        const std::vector<int>* cpus;
+        size_t threads;
+        std::atomic<size_t> arrived;
+        std::atomic<bool> ok;
+    };
+
+    // Pools have no handle on their workers, so each worker is caught
+    // inside a task: a range of one item per thread in which every item
+    // waits for all others. No thread can finish its item and take a second
+    // one before all of them have started, so each worker pins itself once.
+    static void pin_task(void* argument, size_t) {
+        pin_context* ctx = static_cast<pin_context*>(argument);
+        ctx->arrived.fetch_add(1);
+        while (ctx->arrived.load() < ctx->threads) std::this_thread::yield();
+        if (!pin_current_thread(*ctx->cpus)) ctx->ok.store(false);
+    }
+
+    // compute is the compute_1d of the pool's kind
+    template <typename Pool>
+    static bool pin_workers(Pool pool, size_t threads,
+                            void (*compute)(Pool, pthreadpool_function_1d_t, void*, size_t),
+                            const std::vector<int>& cpus) {
+        pin_context ctx;
+        ctx.cpus = &cpus;
+        ctx.threads = threads;
+        ctx.arrived.store(0);
+        ctx.ok.store(true);
+#if defined(__linux__) || defined(__ANDROID__)
+        // pools whose caller takes part in the call would pin it as well
+        cpu_set_t caller;
+        bool restore = sched_getaffinity(0, sizeof(caller), &caller) == 0;
+        compute(pool, pin_task, &ctx, ctx.threads);
+        if (restore) sched_setaffinity(0, sizeof(caller), &caller);
+#else
+        compute(pool, pin_task, &ctx, ctx.threads);
+#endif
+        return ctx.ok.load();
+    }
+
+    bool pin_threadpool(threadpool_t pool, const std::vector<int>& cpus) {
+        if (!pool || cpus.empty()) return false;
+        bool ok = pin_workers(pool, threadpool_threads_count(pool), threadpool_compute_1d, cpus);
+        // NNPACK calls run on the stock pool beside it, which may not exist
+        // yet
+        return threadpool_pin_stock(pool, cpus) && ok;
+    }
+
+#ifdef GALAXY_WITH_NNPACK
+    bool pin_pthreadpool(pthreadpool_t pool, const std::vector<int>& cpus) {
+        if (!pool || cpus.empty()) return false;
+        return pin_workers(pool, pthreadpool_get_threads_count(pool), pthreadpool_compute_1d, cpus);
+    }
+#endif
+} //namespace  galaxy
@@ -0,0 +1,85 @@
+#ifndef THREADING_HPP_
+#define THREADING_HPP_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "profile.hpp"
+#include "threadpool.hpp"
+
+namespace  galaxy {
+    // How many threads each op of a forward pass gets:
+    //   UniformThreads    - every op uses the whole pool;
+    //   CostModelThreads  - from the op's output size and input channels;
+    //   CalibratedThreads - the fastest count measured when a shape is first
+    //                       seen (detector plan, LandmarkNet batch size).
+    enum threadPolicy {UniformThreads, CostModelThreads, CalibratedThreads};
+
+    // Hands out the pool for each op of a forward pass that takes one, in
+    // op order. Without a schedule every op gets the default pool.
+    class OpThreads {
+    public:
+        OpThreads(threadpool_t pool, const std::vector<threadpool_t>* schedule)
+            :pool_(pool), schedule_(schedule), index_(0) {}
+        threadpool_t next() {
+            if (!schedule_ || index_ >= schedule_->size()) return pool_;
+            return (*schedule_)[index_++];
+        }
+
+    private:
+        threadpool_t pool_;
+        const std::vector<threadpool_t>* schedule_;
+        size_t index_;
+    };
+
+    // false for ops that always run on the calling thread
+    bool takes_pool(const LayerStats& op);
+
+    // Thread count per pool-taking op of ops. With inline_small, ops too
+    // small to amortize a fork/join get 1, i.e. run on the caller.
+    std::vector<int> cost_model_threads(const std::vector<LayerStats>& ops,
+                                        int max_threads, bool inline_small);
+
+    // Calls run(threads, ops) repeats times per candidate count, each run
+    // recording its ops, and keeps the count with the lowest median time for
+    // each pool-taking op.
+    std::vector<int> calibrate_threads(const std::vector<int>& candidates, int repeats,
+                                       const std::function<void(int, std::vector<LayerStats>*)>& run);
+
+    // 1, 2, 4, ... up to and including max_threads
+    std::vector<int> thread_candidates(int max_threads);
+
+    // A thread that stays up between jobs, for work that overlaps the
+    // caller's on every frame without starting a thread each time. One job
+    // at a time: start() must be followed by wait() before the next start().
+    class Worker {
+    public:
+        Worker();
+        ~Worker();
+        void start(const std::function<void()>& job);
+        void wait();
+
+    private:
+        Worker(const Worker&);
+        Worker& operator=(const Worker&);
+        void loop();
+
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::function<void()> job_;
+        bool busy_;
+        bool stop_;
+        std::thread thread_;
+    };
+
+    // Restricts every worker of pool to cpus. Returns false when the
+    // platform refuses the mask.
+    bool pin_threadpool(threadpool_t pool, const std::vector<int>& cpus);
+#ifdef GALAXY_WITH_NNPACK
+    bool pin_pthreadpool(pthreadpool_t pool, const std::vector<int>& cpus);
+#endif
+    bool pin_current_thread(const std::vector<int>& cpus);
+} //namespace  galaxy
+#endif //THREADING_HPP_
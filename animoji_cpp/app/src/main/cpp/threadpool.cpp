@@ -0,0 +1,397 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#if defined(__i386__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+#include "threading.hpp"
+#include "threadpool.hpp"
+
+namespace  galaxy {
+    SharedThreadPool::SharedThreadPool(int threads, const PoolOptions& options)
+        :pool_(create_threadpool(threads > 0 ? threads : 0, options)) {
+    }
+
+    SharedThreadPool::~SharedThreadPool() {
+        threadpool_destroy(pool_);
+    }
+
+    int SharedThreadPool::threads() const {
+        return static_cast<int>(threadpool_threads_count(pool_));
+    }
+
+    // Only a weak reference is kept here, so the pool goes away with the last
+    // instance attached to it and the next call creates a new one.
+    std::shared_ptr<SharedThreadPool> SharedThreadPool::global(int threads, const PoolOptions& options) {
+        static std::mutex mutex;
+        static std::weak_ptr<SharedThreadPool> instance;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<SharedThreadPool> pool = instance.lock();
+        if (!pool) {
+            pool.reset(new SharedThreadPool(threads, options));
+            instance = pool;
+        }
+        return pool;
+    }
+} //namespace  galaxy
+
+using namespace std::chrono;
+
+namespace {
+    inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+        _mm_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    // [begin, end) of one thread's items packed into a word, so the owner
+    // (front) and thieves (back) claim items with a single CAS each.
+    struct Range {
+        std::atomic<uint64_t> bounds;
+        char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    inline uint64_t pack(uint32_t begin, uint32_t end) {
+        return (static_cast<uint64_t>(end) << 32) | begin;
+    }
+
+    bool pop_front(Range& range, size_t& item) {
+        uint64_t b = range.bounds.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t begin = static_cast<uint32_t>(b), end = static_cast<uint32_t>(b >> 32);
+            if (begin >= end) return false;
+            if (range.bounds.compare_exchange_weak(b, pack(begin + 1, end),
+                                                   std::memory_order_acq_rel)) {
+                item = begin;
+                return true;
+            }
+        }
+    }
+
+    bool pop_back(Range& range, size_t& item) {
+        uint64_t b = range.bounds.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t begin = static_cast<uint32_t>(b), end = static_cast<uint32_t>(b >> 32);
+            if (begin >= end) return false;
+            if (range.bounds.compare_exchange_weak(b, pack(begin, end - 1),
+                                                   std::memory_order_acq_rel)) {
+                item = end - 1;
+                return true;
+            }
+        }
+    }
+
+    // Every compute_* call becomes items 0..count-1 of a linear task.
+    typedef void (*task_t)(const void* call, size_t item);
+
+    struct call_1d {
+        pthreadpool_function_1d_t function;
+        void* argument;
+    };
+
+    struct call_2d {
+        pthreadpool_function_2d_t function;
+        void* argument;
+        size_t range_j;
+    };
+
+    void task_1d(const void* call, size_t item) {
+        const call_1d* c = static_cast<const call_1d*>(call);
+        c->function(c->argument, item);
+    }
+
+    void task_2d(const void* call, size_t item) {
+        const call_2d* c = static_cast<const call_2d*>(call);
+        c->function(c->argument, item / c->range_j, item % c->range_j);
+    }
+}
+
+namespace  galaxy {
+    struct ThreadPool {
+        size_t threads_count;
+        PoolOptions options;
+        // What NNPACK calls run on; with options.stock also everything else.
+        // A galaxy pool only creates it on the first NNPACK call.
+        std::atomic<pthreadpool_t> stock;
+        // options.spin_us until a stock pool shares the cores
+        std::atomic<int> spin_us;
+        // where pin_threadpool put the workers, for a stock pool made later
+        std::vector<int> cpus;
+        Range* ranges;
+        std::vector<std::thread> workers;
+
+        task_t task;
+        const void* call;
+        std::atomic<uint32_t> generation;
+        std::atomic<size_t> active;         // workers still in the current call
+        std::atomic<int> sleepers;          // workers parked on wake
+        std::atomic<bool> caller_parked;
+        bool stopping;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        // Callers are served in ticket order, so contexts sharing the pool get
+        // its parallel regions in turn rather than whoever wins a mutex.
+        std::atomic<uint32_t> next_ticket;
+        std::atomic<uint32_t> now_serving;
+        std::atomic<int> queued;            // callers parked on turn
+        std::condition_variable turn;
+
+        void acquire() {
+            uint32_t ticket = next_ticket.fetch_add(1);
+            if (now_serving.load() == ticket) return;
+            const int spin = spin_us.load(std::memory_order_relaxed);
+            if (spin > 0) {
+                steady_clock::time_point deadline = steady_clock::now() + microseconds(spin);
+                for (int i = 0; now_serving.load() != ticket; ++i) {
+                    if ((i & 63) == 63 && steady_clock::now() > deadline) break;
+                    cpu_relax();
+                }
+                if (now_serving.load() == ticket) return;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.fetch_add(1);
+            turn.wait(lock, [this, ticket]{ return now_serving.load() == ticket; });
+            queued.fetch_sub(1);
+        }
+
+        void release() {
+            now_serving.fetch_add(1);
+            if (queued.load() > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                turn.notify_all();
+            }
+        }
+
+        void run(size_t tid) {
+            size_t item;
+            while (pop_front(ranges[tid], item)) task(call, item);
+            if (!options.steal) return;
+            for (size_t k = 1; k < threads_count; ++k) {
+                Range& victim = ranges[(tid + k) % threads_count];
+                while (pop_back(victim, item)) task(call, item);
+            }
+        }
+
+        // true once generation differs from seen, false when stopping
+        bool wait_for_work(uint32_t seen) {
+            const int spin = spin_us.load(std::memory_order_relaxed);
+            if (spin > 0) {
+                steady_clock::time_point deadline = steady_clock::now() + microseconds(spin);
+                for (int i = 0; ; ++i) {
+                    if (generation.load() != seen) return true;
+                    if ((i & 63) == 63 && steady_clock::now() > deadline) break;
+                    cpu_relax();
+                }
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [this, seen]{ return stopping || generation.load() != seen; });
+            sleepers.fetch_sub(1);
+            return !stopping;
+        }
+
+        void worker(size_t tid) {
+            uint32_t seen = 0;
+            while (wait_for_work(seen)) {
+                seen = generation.load(std::memory_order_acquire);
+                run(tid);
+                if (active.fetch_sub(1) == 1 && caller_parked.load()) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_one();
+                }
+            }
+        }
+
+        void compute(task_t t, const void* c, size_t count) {
+            if (count == 0) return;
+            if (threads_count == 1 || count == 1) {
+                for (size_t i = 0; i < count; ++i) t(c, i);
+                return;
+            }
+            acquire();
+            task = t;
+            call = c;
+            for (size_t k = 0; k < threads_count; ++k) {
+                ranges[k].bounds.store(pack(static_cast<uint32_t>(count*k/threads_count),
+                                            static_cast<uint32_t>(count*(k + 1)/threads_count)),
+                                       std::memory_order_relaxed);
+            }
+            active.store(threads_count - 1);
+            caller_parked.store(false);
+            // seq_cst against the sleepers increment in wait_for_work: either we
+            // see the sleeper and notify, or it sees the new generation
+            generation.fetch_add(1);
+            if (sleepers.load() > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                wake.notify_all();
+            }
+            run(0);
+
+            const int spin = spin_us.load(std::memory_order_relaxed);
+            if (spin > 0) {
+                steady_clock::time_point deadline = steady_clock::now() + microseconds(spin);
+                for (int i = 0; active.load() != 0; ++i) {
+                    if ((i & 63) == 63 && steady_clock::now() > deadline) break;
+                    cpu_relax();
+                }
+            }
+            if (active.load() != 0) {
+                std::unique_lock<std::mutex> lock(mutex);
+                caller_parked.store(true);
+                done.wait(lock, [this]{ return active.load() == 0; });
+            }
+            release();
+        }
+    };
+
+    threadpool_t create_threadpool(size_t threads, const PoolOptions& options) {
+        if (threads == 0) threads = (std::max)(1u, std::thread::hardware_concurrency());
+#ifdef GALAXY_WITH_NNPACK
+        const bool stock = options.stock;
+#else
+        const bool stock = false;
+#endif
+        void* ranges = NULL;
+        if (!stock && posix_memalign(&ranges, 64, threads*sizeof(Range)) != 0) return NULL;
+        threadpool_t pool = new ThreadPool;
+        pool->threads_count = threads;
+        pool->options = options;
+        pool->options.stock = stock;
+#ifdef GALAXY_WITH_NNPACK
+        pool->stock.store(stock ? pthreadpool_create(threads) : NULL);
+#else
+        pool->stock.store(NULL);
+#endif
+        pool->spin_us.store(stock ? 0 : options.spin_us);
+        pool->ranges = static_cast<Range*>(ranges);
+        for (size_t k = 0; !stock && k < threads; ++k) {
+            new (&pool->ranges[k]) Range;
+            pool->ranges[k].bounds.store(0);
+        }
+        pool->task = NULL;
+        pool->call = NULL;
+        pool->generation.store(0);
+        pool->active.store(0);
+        pool->sleepers.store(0);
+        pool->caller_parked.store(false);
+        pool->stopping = false;
+        pool->next_ticket.store(0);
+        pool->now_serving.store(0);
+        pool->queued.store(0);
+        for (size_t k = 1; !stock && k < threads; ++k) {
+            pool->workers.push_back(std::thread(&ThreadPool::worker, pool, k));
+        }
+        return pool;
+    }
+
+    void threadpool_destroy(threadpool_t pool) {
+        if (!pool) return;
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            pool->stopping = true;
+            pool->wake.notify_all();
+        }
+        for (size_t k = 0; k < pool->workers.size(); ++k) {
+            pool->workers[k].join();
+        }
+#ifdef GALAXY_WITH_NNPACK
+        if (pool->stock.load()) pthreadpool_destroy(pool->stock.load());
+#endif
+        free(pool->ranges);
+        delete pool;
+    }
+
+    size_t threadpool_threads_count(threadpool_t pool) {
+        return pool ? pool->threads_count : 1;
+    }
+
+    void threadpool_compute_1d(threadpool_t pool, pthreadpool_function_1d_t function,
+                               void* argument, size_t range) {
+        if (!pool) {
+            for (size_t i = 0; i < range; ++i) function(argument, i);
+            return;
+        }
+#ifdef GALAXY_WITH_NNPACK
+        if (pool->options.stock) {
+            pool->acquire();
+            pthreadpool_compute_1d(pool->stock.load(), function, argument, range);
+            pool->release();
+            return;
+        }
+#endif
+        call_1d call = {function, argument};
+        pool->compute(task_1d, &call, range);
+    }
+
+    void threadpool_compute_2d(threadpool_t pool, pthreadpool_function_2d_t function,
+                               void* argument, size_t range_i, size_t range_j) {
+        if (!pool) {
+            for (size_t i = 0; i < range_i; ++i)
+                for (size_t j = 0; j < range_j; ++j) function(argument, i, j);
+            return;
+        }
+#ifdef GALAXY_WITH_NNPACK
+        if (pool->options.stock) {
+            pool->acquire();
+            pthreadpool_compute_2d(pool->stock.load(), function, argument, range_i, range_j);
+            pool->release();
+            return;
+        }
+#endif
+        call_2d call = {function, argument, range_j};
+        pool->compute(task_2d, &call, range_i*range_j);
+    }
+
+    // The workers stop spinning from here on: NNPACK's threads need the
+    // cores they would burn between regions.
+    pthreadpool_t nnpack_threadpool(threadpool_t pool) {
+#ifdef GALAXY_WITH_NNPACK
+        if (!pool) return NULL;
+        pthreadpool_t stock = pool->stock.load(std::memory_order_acquire);
+        if (stock) return stock;
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        stock = pool->stock.load();
+        if (stock) return stock;
+        pool->spin_us.store(0);
+        stock = pthreadpool_create(pool->threads_count);
+        if (!pool->cpus.empty()) pin_pthreadpool(stock, pool->cpus);
+        pool->stock.store(stock, std::memory_order_release);
+        return stock;
+#else
+        return NULL;
+#endif
+    }
+
+    // A pool of one thread runs inline and has no turn to take, as in
+    // ThreadPool::compute.
+    NnpackCall::NnpackCall(threadpool_t pool)
+        :pool_(pool && pool->threads_count > 1 ? pool : NULL),
+         stock_(nnpack_threadpool(pool)) {
+        if (pool_) pool_->acquire();
+    }
+
+    NnpackCall::~NnpackCall() {
+        if (pool_) pool_->release();
+    }
+
+    bool threadpool_pin_stock(threadpool_t pool, const std::vector<int>& cpus) {
+        if (!pool) return false;
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->cpus = cpus;
+#ifdef GALAXY_WITH_NNPACK
+        pthreadpool_t stock = pool->stock.load();
+        if (stock && !cpus.empty()) return pin_pthreadpool(stock, cpus);
+#endif
+        return true;
+    }
+} //namespace  galaxy
@@ -0,0 +1,96 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include <pthreadpool.h>
+
+// threadpool.cpp is galaxy's own thread pool behind a private API, so it
+// never clashes with the pthreadpool that libnnpack brings along. NNPACK
+// only accepts pools its pthreadpool created, so NNPACK calls go through
+// nnpack_threadpool(); everything else runs on the galaxy pool. Under the
+// NNPACK backend nearly every op is such a call, so the galaxy pool, its
+// spinning and its stealing only matter to the native backend.
+namespace  galaxy {
+    struct PoolOptions {
+        // After a parallel region, workers busy-wait this long for the next
+        // one before parking on a condition variable; 0 parks at once, which
+        // is what the stock pool does. Dropped to 0 once NNPACK's stock pool
+        // runs beside the workers.
+        int spin_us;
+        // Idle threads take items from the end of other threads' ranges.
+        bool steal;
+        // Runs everything on the stock pthreadpool instead and ignores the
+        // two above, which is how the pools are benchmarked against each
+        // other. Builds without NNPACK have no stock pool and ignore it.
+        bool stock;
+
+        PoolOptions(int spin_us = 0, bool steal = true, bool stock = false)
+            :spin_us(spin_us), steal(steal), stock(stock) {}
+    };
+
+    typedef struct ThreadPool* threadpool_t;
+
+    // threads == 0: one per core. The calling thread of a compute_* call
+    // works on the first range, so a pool of n threads has n - 1 workers.
+    threadpool_t create_threadpool(size_t threads, const PoolOptions& options);
+    void threadpool_destroy(threadpool_t pool);
+    // 1 for NULL, which runs every compute_* call on the caller
+    size_t threadpool_threads_count(threadpool_t pool);
+    void threadpool_compute_1d(threadpool_t pool, pthreadpool_function_1d_t function,
+                               void* argument, size_t range);
+    void threadpool_compute_2d(threadpool_t pool, pthreadpool_function_2d_t function,
+                               void* argument, size_t range_i, size_t range_j);
+    // The pool to hand to NNPACK: the stock pool itself, or a stock pool of
+    // the same size that a galaxy pool creates beside its own threads on the
+    // first call, so native-backend pools never start NNPACK's threads. NULL
+    // for NULL and in builds without NNPACK.
+    pthreadpool_t nnpack_threadpool(threadpool_t pool);
+    // pin_threadpool's part for that stock pool: pins it now if it exists,
+    // and records cpus for one created later.
+    bool threadpool_pin_stock(threadpool_t pool, const std::vector<int>& cpus);
+
+    // Scope of NNPACK calls on pool: holds the pool's turn, so they queue
+    // first come, first served with the galaxy regions of every context on
+    // the pool instead of racing them for the cores.
+    class NnpackCall {
+    public:
+        explicit NnpackCall(threadpool_t pool);
+        ~NnpackCall();
+        // what to hand to NNPACK, see nnpack_threadpool
+        pthreadpool_t pool() const { return stock_; }
+
+    private:
+        NnpackCall(const NnpackCall&);
+        NnpackCall& operator=(const NnpackCall&);
+
+        threadpool_t pool_;
+        pthreadpool_t stock_;
+    };
+
+    // One pool for several DetectNet instances (cameras, model variants), so
+    // they share a thread budget instead of each taking every core. Parallel
+    // regions of different instances, NNPACK calls included, are served
+    // first come, first served.
+    class SharedThreadPool {
+    public:
+        // threads <= 0: one per core
+        explicit SharedThreadPool(int threads = -1, const PoolOptions& options = PoolOptions());
+        ~SharedThreadPool();
+        // The process-wide pool, created on first use with these arguments
+        // and destroyed when the last instance releases it.
+        static std::shared_ptr<SharedThreadPool> global(int threads = -1,
+                                                        const PoolOptions& options = PoolOptions());
+
+        threadpool_t pool() const { return pool_; }
+        int threads() const;
+
+    private:
+        SharedThreadPool(const SharedThreadPool&);
+        SharedThreadPool& operator=(const SharedThreadPool&);
+
+        threadpool_t pool_;
+    };
+} //namespace  galaxy
+#endif //THREADPOOL_HPP_
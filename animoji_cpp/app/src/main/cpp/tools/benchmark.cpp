@@ -0,0 +1,311 @@
+// End-to-end latency benchmark for the host.
+//
+//   benchmark --model detect_landmark.bin [--warmup 10] [--iters 100]
+//             [--threads 1,2,4] [--policy uniform|cost|calibrated]
+//             [--cpus 4,5,6,7] [--spin-us 0,50,200] [--no-steal] [--stock-pool]
+//             [--snapshot model.snap] [--batch 8] [--cascade] [--json out.json]
+//             [--backend nnpack|native] <image or directory>...
+//
+// Runs every image warmup + iters times per thread count and pool spin
+// time and reports p50/p90/p99/max of each stage over all timed runs.
+// --stock-pool runs on the stock pthreadpool instead of galaxy's pool, where
+// --spin-us and --no-steal have no effect; it needs the NNPACK build. The
+// three compare pools under --backend native only: NNPACK ops always run
+// on a stock pool.
+//
+// --model takes the raw .bin or a snapshot. With --snapshot, the snapshot
+// is written from the loaded model if the file does not exist yet, and the
+// cold start (model load, then load plus the first frame) of the raw
+// weights and of the snapshot are reported. Cold here means a fresh Model
+// in this process; the file itself is usually in the page cache.
+//
+// --batch N predicts N images per call with the batched predict, cycling
+// through the images; every sample is then one batch. --cascade runs
+// LandmarkNet's heads on the accepted boxes only. --backend picks the
+// kernels under the ops; the default is NNPACK when it is built in.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "backend.hpp"
+#include "detection.hpp"
+#include "model.hpp"
+
+using namespace galaxy;
+using namespace std::chrono;
+
+static const int kStages = 5;
+static const char* kStageNames[kStages] = {"preprocess", "detect", "decode_nms", "landmark", "total"};
+
+struct Percentiles {
+    float p50, p90, p99, max;
+};
+
+// nearest-rank percentiles
+static Percentiles percentiles(std::vector<float> samples) {
+    Percentiles p = {0, 0, 0, 0};
+    if (samples.empty()) return p;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    p.p50 = samples[(n*50 + 99)/100 - 1];
+    p.p90 = samples[(n*90 + 99)/100 - 1];
+    p.p99 = samples[(n*99 + 99)/100 - 1];
+    p.max = samples[n - 1];
+    return p;
+}
+
+static bool is_image(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+}
+
+static void collect_images(const std::string& path, std::vector<std::string>& files) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (is_image(entry->d_name)) names.push_back(path + "/" + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    files.insert(files.end(), names.begin(), names.end());
+}
+
+static const int kColdRuns = 5;
+
+struct ColdStart {
+    float load, first_frame;
+};
+
+static std::shared_ptr<Model> load_model(const std::string& path) {
+    if (Model::is_snapshot(path)) {
+        std::shared_ptr<Model> model = Model::load_snapshot(path);
+        if (!model) exit(EXIT_FAILURE);
+        return model;
+    }
+    std::shared_ptr<Model> model(new Model);
+    model->load_weight(path);
+    return model;
+}
+
+// median over kColdRuns fresh loads
+static ColdStart cold_start(const std::string& path, const cv::Mat& im) {
+    std::vector<float> load, first_frame;
+    for (int i = 0; i < kColdRuns; ++i) {
+        high_resolution_clock::time_point begin = high_resolution_clock::now();
+        std::shared_ptr<Model> model = load_model(path);
+        high_resolution_clock::time_point loaded = high_resolution_clock::now();
+        DetectNet net(model);
+        net.predict(im);
+        high_resolution_clock::time_point end = high_resolution_clock::now();
+        load.push_back((float)duration_cast<microseconds>(loaded - begin).count()*1e-3);
+        first_frame.push_back((float)duration_cast<microseconds>(end - begin).count()*1e-3);
+    }
+    ColdStart c = {percentiles(load).p50, percentiles(first_frame).p50};
+    return c;
+}
+
+static std::vector<int> parse_list(const char* arg) {
+    std::vector<int> values;
+    for (const char* p = arg; *p; ) {
+        values.push_back(atoi(p));
+        const char* comma = strchr(p, ',');
+        if (!comma) break;
+        p = comma + 1;
+    }
+    return values;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s --model <file> [--warmup N] [--iters N] [--threads 1,2,4]\n"
+                    "          [--policy uniform|cost|calibrated] [--cpus 4,5,6,7]\n"
+                    "          [--spin-us 0,50,200] [--no-steal] [--stock-pool]\n"
+                    "          [--snapshot <file>] [--batch N] [--cascade] [--json <file>]\n"
+                    "          [--backend nnpack|native] <image or directory>...\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    std::string model_path, json_path, snapshot_path;
+    int warmup = 10;
+    int iters = 100;
+    int batch = 1;
+    bool cascade = false;
+    std::vector<int> threads(1, -1);
+    std::vector<int> cpus;
+    std::vector<int> spins(1, 0);
+    bool steal = true;
+    bool stock = false;
+    threadPolicy policy = UniformThreads;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--model" && has_value) model_path = argv[++i];
+        else if (arg == "--warmup" && has_value) warmup = atoi(argv[++i]);
+        else if (arg == "--iters" && has_value) iters = atoi(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = parse_list(argv[++i]);
+        else if (arg == "--cpus" && has_value) cpus = parse_list(argv[++i]);
+        else if (arg == "--spin-us" && has_value) spins = parse_list(argv[++i]);
+        else if (arg == "--no-steal") steal = false;
+        else if (arg == "--stock-pool") stock = true;
+        else if (arg == "--policy" && has_value) {
+            std::string name = argv[++i];
+            if (name == "uniform") policy = UniformThreads;
+            else if (name == "cost") policy = CostModelThreads;
+            else if (name == "calibrated") policy = CalibratedThreads;
+            else usage(argv[0]);
+        }
+        else if (arg == "--snapshot" && has_value) snapshot_path = argv[++i];
+        else if (arg == "--batch" && has_value) batch = atoi(argv[++i]);
+        else if (arg == "--cascade") cascade = true;
+        else if (arg == "--json" && has_value) json_path = argv[++i];
+        else if (arg == "--backend" && has_value) {
+            std::string name = argv[++i];
+            if ((name != "native" && name != "nnpack")
+                || !set_backend(name == "native" ? NativeBackend : NnpackBackend)) {
+                fprintf(stderr, "Backend not available: %s\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg[0] == '-') usage(argv[0]);
+        else collect_images(arg, files);
+    }
+    if (model_path.empty() || files.empty() || iters <= 0 || batch <= 0) usage(argv[0]);
+    // the stock pool comes with libnnpack
+    if (stock && !nnpack_backend()) {
+        fprintf(stderr, "--stock-pool needs the NNPACK build\n");
+        return EXIT_FAILURE;
+    }
+    bool spinning = false;
+    for (size_t i = 0; i < spins.size(); ++i) spinning = spinning || spins[i] > 0;
+    if (backend_type() == NnpackBackend && (spinning || !steal || stock)) {
+        fprintf(stderr, "--spin-us, --no-steal and --stock-pool need --backend native\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<cv::Mat> images;
+    for (size_t i = 0; i < files.size(); ++i) {
+        cv::Mat im = cv::imread(files[i]);
+        if (im.empty()) {
+            fprintf(stderr, "Cannot read image: %s\n", files[i].c_str());
+            return EXIT_FAILURE;
+        }
+        images.push_back(im);
+    }
+
+    std::shared_ptr<Model> model = load_model(model_path);
+    if (!snapshot_path.empty() && !Model::is_snapshot(snapshot_path)) {
+        DetectNet net(model);
+        net.save_snapshot(snapshot_path);
+    }
+
+    printf("backend %s\n", backend().name());
+    FILE* json = NULL;
+    if (!json_path.empty()) {
+        json = fopen(json_path.c_str(), "w");
+        if (!json) {
+            fprintf(stderr, "Open file fail: %s\n", json_path.c_str());
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\"backend\":\"%s\",\"images\":%zu,\"warmup\":%d,\"iters\":%d,\"runs\":[",
+                backend().name(), images.size(), warmup, iters);
+    }
+
+    for (size_t run = 0; run < threads.size()*spins.size(); ++run) {
+        size_t t = run / spins.size();
+        PoolOptions pool(spins[run % spins.size()], steal, stock);
+        DetectNet net(model, threads[t], pool);
+        InferenceContext& ctx = net.context();
+        ctx.set_cpu_affinity(cpus);
+        ctx.set_thread_policy(policy);
+        ctx.set_landmark_cascade(cascade);
+        std::vector<float> samples[kStages];
+        size_t faces = 0;
+        for (int it = -warmup; it < iters; ++it) {
+            for (size_t i = 0; i < images.size(); i += batch) {
+                size_t nfaces = 0;
+                high_resolution_clock::time_point begin = high_resolution_clock::now();
+                if (batch > 1) {
+                    std::vector<cv::Mat> group;
+                    for (int k = 0; k < batch; ++k) {
+                        group.push_back(images[(i + k) % images.size()]);
+                    }
+                    std::vector<std::vector<bbox> > boxes = net.predict(group);
+                    for (size_t k = 0; k < boxes.size(); ++k) {
+                        nfaces += boxes[k].size();
+                    }
+                } else {
+                    nfaces = net.predict(images[i]).size();
+                }
+                high_resolution_clock::time_point end = high_resolution_clock::now();
+                if (it < 0) continue;
+                const InferenceStats& stats = ctx.stats();
+                samples[0].push_back(stats.preprocess_time);
+                samples[1].push_back(stats.forward_time);
+                samples[2].push_back(stats.decode_time);
+                samples[3].push_back(stats.landmark_time);
+                samples[4].push_back((float)duration_cast<microseconds>(end - begin).count()*1e-3);
+                faces += nfaces;
+            }
+        }
+
+        if (pool.stock)
+            printf("threads %d, stock pool, batch %d: %zu runs, %.2f faces/run\n", ctx.num_threads(),
+                   batch, samples[4].size(), (float)faces/samples[4].size());
+        else
+            printf("threads %d, spin %d us%s, batch %d: %zu runs, %.2f faces/run\n", ctx.num_threads(),
+                   pool.spin_us, pool.steal ? "" : ", no stealing", batch,
+                   samples[4].size(), (float)faces/samples[4].size());
+        printf("  %-12s %9s %9s %9s %9s\n", "stage (ms)", "p50", "p90", "p99", "max");
+        if (json && pool.stock)
+            fprintf(json, "%s{\"threads\":%d,\"pool\":\"stock\",\"batch\":%d,\"stages\":{",
+                    run ? "," : "", ctx.num_threads(), batch);
+        else if (json)
+            fprintf(json, "%s{\"threads\":%d,\"pool\":\"galaxy\",\"spin_us\":%d,\"steal\":%s,\"batch\":%d,\"stages\":{",
+                    run ? "," : "", ctx.num_threads(), pool.spin_us, pool.steal ? "true" : "false",
+                    batch);
+        for (int s = 0; s < kStages; ++s) {
+            Percentiles p = percentiles(samples[s]);
+            printf("  %-12s %9.3f %9.3f %9.3f %9.3f\n", kStageNames[s], p.p50, p.p90, p.p99, p.max);
+            if (json) fprintf(json, "%s\"%s\":{\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+                              s ? "," : "", kStageNames[s], p.p50, p.p90, p.p99, p.max);
+        }
+        if (json) fprintf(json, "}}");
+    }
+    if (json) fprintf(json, "]");
+
+    if (!snapshot_path.empty()) {
+        printf("cold start (ms)    load  first frame\n");
+        if (json) fprintf(json, ",\"cold_start\":{");
+        const std::string* paths[2] = {&model_path, &snapshot_path};
+        const char* names[2] = {"raw", "snapshot"};
+        bool first = true;
+        for (int k = 0; k < 2; ++k) {
+            if (k == 0 && Model::is_snapshot(model_path)) continue;
+            ColdStart c = cold_start(*paths[k], images[0]);
+            printf("  %-12s %9.3f %12.3f\n", names[k], c.load, c.first_frame);
+            if (json) fprintf(json, "%s\"%s\":{\"load\":%.4f,\"first_frame\":%.4f}",
+                              first ? "" : ",", names[k], c.load, c.first_frame);
+            first = false;
+        }
+        if (json) fprintf(json, "}");
+    }
+    if (json) {
+        fprintf(json, "}\n");
+        fclose(json);
+    }
+    return 0;
+}
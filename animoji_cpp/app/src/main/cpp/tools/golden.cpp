@@ -0,0 +1,342 @@
+// Golden-output accuracy harness.
+//
+//   golden --model <file> --write <dir> [mode] <image>...
+//   golden --model <file> --check <dir> [mode] [--max-px 2.0] <image>...
+//
+// mode: [--threads N] [--input WxH] [--resize stretch|letterbox|keepaspect]
+//       [--yuv] [--backend nnpack|native]
+//
+// --write stores, per image, every layer output of both nets, the final
+// boxes and their 75 landmarks in <dir>/<image name>.golden; write them with
+// the plain FP32 configuration. --check runs the given mode on the same
+// images and reports max/mean absolute error per layer, box IoU and
+// landmark pixel error. The exit status is non-zero when a face is missing
+// or a landmark moves more than --max-px.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "backend.hpp"
+#include "detection.hpp"
+#include "model.hpp"
+
+using namespace galaxy;
+
+static const int kPoints = 75;
+
+struct Layer {
+    std::string op;
+    Shape shape;
+    std::vector<float> data;
+};
+
+struct Face {
+    int x1, y1, x2, y2;
+    float score;
+    std::vector<float> points;    // kPoints (x, y) pairs, empty without landmarks
+};
+
+struct Golden {
+    std::vector<Layer> detect_layers;
+    std::vector<Layer> landmark_layers;
+    std::vector<Face> faces;
+};
+
+static void write_layers(FILE* fp, const std::vector<Layer>& layers) {
+    int n = static_cast<int>(layers.size());
+    fwrite(&n, sizeof(n), 1, fp);
+    for (int i = 0; i < n; ++i) {
+        const Layer& layer = layers[i];
+        int len = static_cast<int>(layer.op.size());
+        fwrite(&len, sizeof(len), 1, fp);
+        fwrite(layer.op.data(), 1, len, fp);
+        int axes = static_cast<int>(layer.shape.size());
+        fwrite(&axes, sizeof(axes), 1, fp);
+        fwrite(layer.shape.data(), sizeof(int), axes, fp);
+        int count = static_cast<int>(layer.data.size());
+        fwrite(&count, sizeof(count), 1, fp);
+        fwrite(layer.data.data(), sizeof(float), count, fp);
+    }
+}
+
+static bool read_int(FILE* fp, int* v) {
+    return fread(v, sizeof(*v), 1, fp) == 1;
+}
+
+static bool read_layers(FILE* fp, std::vector<Layer>& layers) {
+    int n;
+    if (!read_int(fp, &n) || n < 0) return false;
+    layers.resize(n);
+    for (int i = 0; i < n; ++i) {
+        Layer& layer = layers[i];
+        int len, axes, count;
+        if (!read_int(fp, &len) || len < 0) return false;
+        layer.op.resize(len);
+        if (fread(&layer.op[0], 1, len, fp) != size_t(len)) return false;
+        if (!read_int(fp, &axes) || axes < 0) return false;
+        layer.shape.resize(axes);
+        if (fread(layer.shape.data(), sizeof(int), axes, fp) != size_t(axes)) return false;
+        if (!read_int(fp, &count) || count < 0) return false;
+        layer.data.resize(count);
+        if (fread(layer.data.data(), sizeof(float), count, fp) != size_t(count)) return false;
+    }
+    return true;
+}
+
+static bool save(const std::string& path, const Golden& golden) {
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    fwrite("GLD1", 1, 4, fp);
+    write_layers(fp, golden.detect_layers);
+    write_layers(fp, golden.landmark_layers);
+    int n = static_cast<int>(golden.faces.size());
+    fwrite(&n, sizeof(n), 1, fp);
+    for (int i = 0; i < n; ++i) {
+        const Face& f = golden.faces[i];
+        int box[4] = {f.x1, f.y1, f.x2, f.y2};
+        fwrite(box, sizeof(int), 4, fp);
+        fwrite(&f.score, sizeof(float), 1, fp);
+        int has_points = f.points.empty() ? 0 : 1;
+        fwrite(&has_points, sizeof(int), 1, fp);
+        if (has_points) fwrite(f.points.data(), sizeof(float), 2*kPoints, fp);
+    }
+    return fclose(fp) == 0;
+}
+
+static bool load(const std::string& path, Golden& golden) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    char magic[4];
+    bool ok = fread(magic, 1, 4, fp) == 4 && memcmp(magic, "GLD1", 4) == 0 &&
+              read_layers(fp, golden.detect_layers) && read_layers(fp, golden.landmark_layers);
+    int n = 0;
+    ok = ok && read_int(fp, &n) && n >= 0;
+    golden.faces.resize(ok ? n : 0);
+    for (int i = 0; ok && i < n; ++i) {
+        Face& f = golden.faces[i];
+        int box[4], has_points;
+        ok = fread(box, sizeof(int), 4, fp) == 4 && fread(&f.score, sizeof(float), 1, fp) == 1 &&
+             read_int(fp, &has_points);
+        f.x1 = box[0]; f.y1 = box[1]; f.x2 = box[2]; f.y2 = box[3];
+        if (ok && has_points) {
+            f.points.resize(2*kPoints);
+            ok = fread(f.points.data(), sizeof(float), 2*kPoints, fp) == size_t(2*kPoints);
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void copy_layers(const std::vector<LayerStats>& stats, std::vector<Layer>& layers) {
+    layers.resize(stats.size());
+    for (size_t i = 0; i < stats.size(); ++i) {
+        layers[i].op = stats[i].op;
+        layers[i].shape = stats[i].output_shape;
+        layers[i].data = stats[i].output;
+    }
+}
+
+struct Mode {
+    int threads;
+    int width, height;
+    resizeMode resize;
+    bool yuv;
+};
+
+static Golden run(DetectNet& net, const cv::Mat& image, const Mode& mode) {
+    std::vector<bbox> boxes;
+    if (mode.yuv) {
+        cv::Mat even = image(cv::Rect(0, 0, image.cols & ~1, image.rows & ~1));
+        cv::Mat i420;
+        cv::cvtColor(even, i420, cv::COLOR_BGR2YUV_I420);
+        int w = even.cols, h = even.rows;
+        const unsigned char* y = i420.data;
+        const unsigned char* u = y + w*h;
+        const unsigned char* v = u + (w/2)*(h/2);
+        boxes = net.predict(y, w, u, w/2, v, w/2, w, h);
+    }
+    else {
+        boxes = net.predict(image);
+    }
+    Golden result;
+    const InferenceStats& stats = net.context().stats();
+    copy_layers(stats.detect_layers, result.detect_layers);
+    copy_layers(stats.landmark_layers, result.landmark_layers);
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        Face f;
+        f.x1 = boxes[i].x1; f.y1 = boxes[i].y1; f.x2 = boxes[i].x2; f.y2 = boxes[i].y2;
+        f.score = boxes[i].score;
+        if (boxes[i].array()) f.points.assign(boxes[i].array(), boxes[i].array() + 2*kPoints);
+        result.faces.push_back(f);
+    }
+    return result;
+}
+
+// worst and mean absolute error of one layer, accumulated over images
+struct LayerError {
+    std::string op;
+    float max;
+    double sum;
+    long long count;
+    int mismatched;
+};
+
+static void compare_layers(const std::vector<Layer>& golden, const std::vector<Layer>& test,
+                           std::vector<LayerError>& errors) {
+    if (errors.size() < golden.size()) errors.resize(golden.size(), LayerError{"", 0, 0, 0, 0});
+    for (size_t i = 0; i < golden.size(); ++i) {
+        LayerError& e = errors[i];
+        e.op = golden[i].op;
+        if (i >= test.size() || test[i].shape != golden[i].shape) {
+            e.mismatched++;
+            continue;
+        }
+        const std::vector<float>& a = golden[i].data;
+        const std::vector<float>& b = test[i].data;
+        for (size_t k = 0; k < a.size(); ++k) {
+            float d = fabsf(a[k] - b[k]);
+            e.max = (std::max)(e.max, d);
+            e.sum += d;
+        }
+        e.count += a.size();
+    }
+}
+
+static void print_layers(const char* net, const std::vector<LayerError>& errors) {
+    for (size_t i = 0; i < errors.size(); ++i) {
+        const LayerError& e = errors[i];
+        printf("  %-8s %3zu %-8s max %.3e  mean %.3e%s\n", net, i, e.op.c_str(), e.max,
+               e.count ? e.sum/e.count : 0.0,
+               e.mismatched ? "  (shape differs on some images)" : "");
+    }
+}
+
+static float box_iou(const Face& a, const Face& b) {
+    return iou(bbox(a.x1, a.y1, a.x2, a.y2, a.score), bbox(b.x1, b.y1, b.x2, b.y2, b.score));
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "usage: %s --model <file> (--write|--check) <dir> [--threads N]\n"
+                    "          [--input WxH] [--resize stretch|letterbox|keepaspect] [--yuv]\n"
+                    "          [--backend nnpack|native] [--max-px P] <image>...\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    std::string model_path, dir;
+    bool write = false;
+    float max_px = 2.0f;
+    Mode mode = {-1, 112, 112, Stretch, false};
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--model" && has_value) model_path = argv[++i];
+        else if (arg == "--write" && has_value) { write = true; dir = argv[++i]; }
+        else if (arg == "--check" && has_value) { write = false; dir = argv[++i]; }
+        else if (arg == "--threads" && has_value) mode.threads = atoi(argv[++i]);
+        else if (arg == "--input" && has_value) sscanf(argv[++i], "%dx%d", &mode.width, &mode.height);
+        else if (arg == "--resize" && has_value) {
+            std::string r = argv[++i];
+            if (r == "stretch") mode.resize = Stretch;
+            else if (r == "letterbox") mode.resize = Letterbox;
+            else if (r == "keepaspect") mode.resize = KeepAspect;
+            else usage(argv[0]);
+        }
+        else if (arg == "--yuv") mode.yuv = true;
+        else if (arg == "--backend" && has_value) {
+            std::string name = argv[++i];
+            if ((name != "native" && name != "nnpack")
+                || !set_backend(name == "native" ? NativeBackend : NnpackBackend)) {
+                fprintf(stderr, "Backend not available: %s\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--max-px" && has_value) max_px = (float)atof(argv[++i]);
+        else if (arg[0] == '-') usage(argv[0]);
+        else files.push_back(arg);
+    }
+    if (model_path.empty() || dir.empty() || files.empty()) usage(argv[0]);
+
+    DetectNet net(mode.threads);
+    net.load_weight(model_path);
+    net.set_input_size(mode.width, mode.height, mode.resize);
+    net.context().set_profiling(true, true);
+
+    std::vector<LayerError> detect_errors, landmark_errors;
+    bool failed = false;
+    for (size_t i = 0; i < files.size(); ++i) {
+        cv::Mat image = cv::imread(files[i]);
+        if (image.empty()) {
+            fprintf(stderr, "Cannot read image: %s\n", files[i].c_str());
+            return EXIT_FAILURE;
+        }
+        size_t slash = files[i].rfind('/');
+        std::string golden_path = dir + "/" +
+                (slash == std::string::npos ? files[i] : files[i].substr(slash + 1)) + ".golden";
+        Golden result = run(net, image, mode);
+        if (write) {
+            if (!save(golden_path, result)) {
+                fprintf(stderr, "Cannot write %s\n", golden_path.c_str());
+                return EXIT_FAILURE;
+            }
+            printf("%s: %zu faces -> %s\n", files[i].c_str(), result.faces.size(), golden_path.c_str());
+            continue;
+        }
+
+        Golden golden;
+        if (!load(golden_path, golden)) {
+            fprintf(stderr, "Cannot read %s\n", golden_path.c_str());
+            return EXIT_FAILURE;
+        }
+        compare_layers(golden.detect_layers, result.detect_layers, detect_errors);
+        compare_layers(golden.landmark_layers, result.landmark_layers, landmark_errors);
+
+        // greedy one-to-one matching by IoU
+        std::vector<bool> used(result.faces.size(), false);
+        int matched = 0;
+        float min_iou = 1.0f, sum_iou = 0.0f, max_err = 0.0f;
+        double sum_err = 0.0;
+        int points = 0;
+        for (size_t g = 0; g < golden.faces.size(); ++g) {
+            int best = -1;
+            float best_iou = 0.0f;
+            for (size_t t = 0; t < result.faces.size(); ++t) {
+                float o = used[t] ? 0.0f : box_iou(golden.faces[g], result.faces[t]);
+                if (o > best_iou) { best_iou = o; best = static_cast<int>(t); }
+            }
+            if (best < 0) continue;
+            used[best] = true;
+            matched++;
+            min_iou = (std::min)(min_iou, best_iou);
+            sum_iou += best_iou;
+            const std::vector<float>& a = golden.faces[g].points;
+            const std::vector<float>& b = result.faces[best].points;
+            if (a.empty() || b.empty()) continue;
+            for (int p = 0; p < kPoints; ++p) {
+                float d = hypotf(a[2*p] - b[2*p], a[2*p + 1] - b[2*p + 1]);
+                max_err = (std::max)(max_err, d);
+                sum_err += d;
+                points++;
+            }
+        }
+        printf("%s: faces %zu golden / %zu test, %d matched, IoU mean %.4f min %.4f, "
+               "landmark px mean %.3f max %.3f\n", files[i].c_str(), golden.faces.size(),
+               result.faces.size(), matched, matched ? sum_iou/matched : 0.0f,
+               matched ? min_iou : 0.0f, points ? sum_err/points : 0.0, max_err);
+        if (matched != (int)golden.faces.size() || result.faces.size() != golden.faces.size() ||
+            max_err > max_px) failed = true;
+    }
+    if (!write) {
+        printf("per-layer absolute error:\n");
+        print_layers("detect", detect_errors);
+        print_layers("landmark", landmark_errors);
+        printf("%s\n", failed ? "FAIL" : "PASS");
+    }
+    return failed ? EXIT_FAILURE : 0;
+}
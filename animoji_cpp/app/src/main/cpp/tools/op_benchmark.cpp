@@ -0,0 +1,509 @@
+// Operator microbenchmarks at the layer shapes of DetectNet and LandmarkNet.
+//
+//   op_benchmark [--input 112x112] [--faces 1,2,4,8,16] [--threads 1,2,4]
+//                [--iters 50] [--json out.json]
+//
+// Every op of both forward passes is timed on random data with each
+// NNPACK convolution algorithm and each thread count; the median time is
+// reported with the achieved GFLOP/s and GB/s (inputs + weights + outputs
+// touched once). Unsupported algorithm/shape pairs are skipped. The
+// "backend" row of a convolution bypasses the direct 3x3 kernels that
+// conv_forward uses for few-channel layers under the native backend; the
+// "direct3x3" row times those kernels on their own, to compare them
+// with NNPACK. FC and 1x1 layers also get "sparse/<density>" rows: the
+// block-sparse kernels on weights pruned to that share of blocks, next to
+// the "dense" row of the same pruned weights; each sparse result is
+// checked against the dense one, and the highest density at which sparse
+// still wins is printed per layer, which is what kSparseMaxDensity is
+// taken from.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <nnpack.h>
+#include "backend.hpp"
+#include "blob.hpp"
+#include "direct_conv.hpp"
+#include "math_functions.hpp"
+#include "model.hpp"
+#include "sparse.hpp"
+
+using namespace galaxy;
+using namespace std::chrono;
+
+enum opKind {Conv, Pool, Leaky, Prelu, Fc, Softmax};
+
+// One op of a forward pass; src is the index of the op whose output feeds
+// this one, or -1 for the previous op (or the net input).
+struct OpSpec {
+    opKind kind;
+    int param;
+    int pad;
+    int size;
+    int stride;
+    padType pad_type;
+    int src;
+};
+
+// mirrors DetectNet::forward
+static const OpSpec detect_ops[] = {
+    {Conv, 0, 1, 0, 1, None, -1}, {Pool, 0, 0, 2, 2, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 2, 1, 0, 1, None, -1}, {Pool, 0, 0, 2, 2, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 4, 1, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 6, 0, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 8, 1, 0, 1, None, -1}, {Pool, 0, 0, 2, 2, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 10, 1, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 12, 0, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 14, 1, 0, 1, None, -1}, {Pool, 0, 0, 2, 2, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 16, 1, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 18, 0, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 20, 1, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 22, 0, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 24, 1, 0, 1, None, -1}, {Leaky, 0, 0, 0, 0, None, -1},
+    {Conv, 26, 0, 0, 1, None, -1},
+};
+
+// mirrors LandmarkNet::forward
+static const OpSpec landmark_ops[] = {
+    {Conv, 0, 0, 0, 1, None, -1}, {Pool, 0, 0, 3, 2, Same, -1}, {Prelu, 2, 0, 0, 0, None, -1},
+    {Conv, 3, 0, 0, 1, None, -1}, {Pool, 0, 0, 3, 2, Valid, -1}, {Prelu, 5, 0, 0, 0, None, -1},
+    {Conv, 6, 0, 0, 1, None, -1}, {Pool, 0, 0, 2, 2, Same, -1}, {Prelu, 8, 0, 0, 0, None, -1},
+    {Conv, 9, 0, 0, 1, None, -1}, {Prelu, 11, 0, 0, 0, None, -1},
+    {Fc, 12, 0, 0, 0, None, -1}, {Prelu, 14, 0, 0, 0, None, -1},
+    {Fc, 15, 0, 0, 0, None, -1}, {Softmax, 0, 0, 0, 0, None, -1},
+    {Fc, 17, 0, 0, 0, None, 12}, {Fc, 19, 0, 0, 0, None, 12}, {Fc, 21, 0, 0, 0, None, 12},
+};
+
+struct Algorithm {
+    const char* name;
+    enum nnp_convolution_algorithm algorithm;
+};
+
+static const Algorithm algorithms[] = {
+    {"auto", nnp_convolution_algorithm_auto},
+    {"ft8x8", nnp_convolution_algorithm_ft8x8},
+    {"ft16x16", nnp_convolution_algorithm_ft16x16},
+    {"wt8x8", nnp_convolution_algorithm_wt8x8},
+    {"implicit_gemm", nnp_convolution_algorithm_implicit_gemm},
+    {"direct", nnp_convolution_algorithm_direct},
+};
+
+static int iters = 50;
+static FILE* json = NULL;
+static bool first_json = true;
+
+static void fill_random(Blob* blob) {
+    float* data = blob->data();
+    for (int i = 0; i < blob->count(); ++i) {
+        data[i] = (float)rand()/RAND_MAX - 0.5f;
+    }
+}
+
+// median over iters runs after a short warm-up; negative when fn fails
+static float time_ms(const std::function<bool()>& fn) {
+    for (int i = 0; i < 3; ++i) {
+        if (!fn()) return -1.0f;
+    }
+    std::vector<float> samples(iters);
+    for (int i = 0; i < iters; ++i) {
+        high_resolution_clock::time_point begin = high_resolution_clock::now();
+        fn();
+        samples[i] = (float)duration_cast<nanoseconds>(high_resolution_clock::now() - begin).count()*1e-6;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[iters/2];
+}
+
+static std::string shape_string(const Shape& shape) {
+    std::string s;
+    for (size_t i = 0; i < shape.size(); ++i) {
+        s += (i ? "x" : "") + std::to_string(shape[i]);
+    }
+    return s;
+}
+
+static void report(const char* net, int layer, const char* op, const std::string& variant,
+                   const Shape& input, const Shape& output, int threads,
+                   float ms, double flops, double bytes) {
+    if (ms < 0) return;
+    double gflops = flops/(ms*1e6);
+    double gbps = bytes/(ms*1e6);
+    printf("%-8s %3d %-8s %-22s %-14s %-14s %3d %10.4f %8.2f %8.2f\n", net, layer, op,
+           variant.c_str(), shape_string(input).c_str(), shape_string(output).c_str(),
+           threads, ms, gflops, gbps);
+    if (!json) return;
+    fprintf(json, "%s{\"net\":\"%s\",\"layer\":%d,\"op\":\"%s\",\"variant\":\"%s\","
+                  "\"input\":\"%s\",\"output\":\"%s\",\"threads\":%d,\"ms\":%.5f,"
+                  "\"gflops\":%.3f,\"gbps\":%.3f}",
+            first_json ? "" : ",\n", net, layer, op, variant.c_str(),
+            shape_string(input).c_str(), shape_string(output).c_str(),
+            threads, ms, gflops, gbps);
+    first_json = false;
+}
+
+static void bench_conv(const char* net, int layer, const Blob* input, const Blob* w,
+                       const Blob* b, int pad, threadpool_t pool, int threads) {
+    Blob* output = NULL;
+    Workspace workspace;
+    conv_forward(input, output, w, b, pool, pad, pad, 1, false, &workspace);
+    const Shape& is = input->shape();
+    const Shape& os = output->shape();
+    int batch = is[0];
+    double flops = 2.0*os[0]*os[1]*os[2]*os[3]*is[1]*w->shape(2)*w->shape(3);
+    double bytes = 4.0*(input->count() + w->count() + output->count());
+
+    float ms = time_ms([&]() {
+        conv_forward(input, output, w, b, pool, pad, pad, 1, false, &workspace);
+        return true;
+    });
+    report(net, layer, "conv", "conv_forward", is, os, threads, ms, flops, bytes);
+
+    ms = time_ms([&]() {
+        backend().convolution(input, output, w, b, pad, pad, 1, false, &workspace,
+                              NULL, pool, NULL);
+        return true;
+    });
+    report(net, layer, "conv", std::string("backend/") + backend().name(),
+           is, os, threads, ms, flops, bytes);
+
+    direct_conv3x3_fn direct = w->shape(2) == 3 && w->shape(3) == 3
+                               ? find_direct_conv3x3(is[1], os[1], 1) : NULL;
+    if (direct) {
+        ms = time_ms([&]() {
+            for (int n = 0; n < batch; ++n) {
+                direct(input->data() + n*input->count()/batch, is[2], is[3], w->data(), b->data(),
+                       output->data() + n*output->count()/batch, pad, pad, pad, pad, false, pool);
+            }
+            return true;
+        });
+        report(net, layer, "conv", "direct3x3", is, os, threads, ms, flops, bytes);
+    }
+
+    struct nnp_size input_size = {size_t(is[3]), size_t(is[2])};
+    struct nnp_padding padding = {size_t(pad), size_t(pad), size_t(pad), size_t(pad)};
+    struct nnp_size kernel_size = {size_t(w->shape(3)), size_t(w->shape(2))};
+    struct nnp_size stride = {1, 1};
+    size_t in_count = input->count()/batch;
+    size_t out_count = output->count()/batch;
+    pthreadpool_t nnpack_pool = nnpack_threadpool(pool);
+    for (size_t a = 0; a < sizeof(algorithms)/sizeof(algorithms[0]); ++a) {
+        enum nnp_convolution_algorithm algorithm = algorithms[a].algorithm;
+        Workspace ws;
+        size_t size = 0;
+        if (nnp_convolution_inference(algorithm, nnp_convolution_transform_strategy_compute,
+                                      size_t(is[1]), size_t(os[1]), input_size, padding,
+                                      kernel_size, stride, input->data(), w->data(), b->data(),
+                                      output->data(), NULL, &size, nnp_activation_identity,
+                                      NULL, nnpack_pool, NULL) != nnp_status_success) continue;
+        ws.reserve(size);
+        ms = time_ms([&]() {
+            for (int n = 0; n < batch; ++n) {
+                size_t ws_size = ws.size;
+                if (nnp_convolution_inference(algorithm, nnp_convolution_transform_strategy_compute,
+                                              size_t(is[1]), size_t(os[1]), input_size, padding,
+                                              kernel_size, stride, input->data() + n*in_count,
+                                              w->data(), b->data(), output->data() + n*out_count,
+                                              ws.data, ws.data ? &ws_size : NULL,
+                                              nnp_activation_identity, NULL, nnpack_pool, NULL)
+                    != nnp_status_success) return false;
+            }
+            return true;
+        });
+        report(net, layer, "conv", std::string("inference/") + algorithms[a].name,
+               is, os, threads, ms, flops, bytes);
+
+        if (batch > 1) {
+            size = 0;
+            if (nnp_convolution_output(algorithm, size_t(batch), size_t(is[1]), size_t(os[1]),
+                                       input_size, padding, kernel_size, input->data(),
+                                       w->data(), b->data(), output->data(), NULL, &size,
+                                       nnp_activation_identity, NULL, nnpack_pool, NULL)
+                == nnp_status_success) {
+                ws.reserve(size);
+                ms = time_ms([&]() {
+                    size_t ws_size = ws.size;
+                    return nnp_convolution_output(algorithm, size_t(batch), size_t(is[1]),
+                                                  size_t(os[1]), input_size, padding, kernel_size,
+                                                  input->data(), w->data(), b->data(),
+                                                  output->data(), ws.data,
+                                                  ws.data ? &ws_size : NULL,
+                                                  nnp_activation_identity, NULL, nnpack_pool, NULL)
+                           == nnp_status_success;
+                });
+                report(net, layer, "conv", std::string("output/") + algorithms[a].name,
+                       is, os, threads, ms, flops, bytes);
+            }
+        }
+    }
+
+    // the Model's precomputed Winograd kernel, as used for single images
+    size_t size = 0;
+    if (nnp_convolution_inference(nnp_convolution_algorithm_wt8x8,
+                                  nnp_convolution_transform_strategy_precompute,
+                                  size_t(is[1]), size_t(os[1]), input_size, padding, kernel_size,
+                                  stride, NULL, w->data(), NULL, NULL, NULL, &size,
+                                  nnp_activation_identity, NULL, NULL, NULL) == nnp_status_success
+        && size > 0) {
+        Blob transformed(int((size + sizeof(float) - 1)/sizeof(float)));
+        size = transformed.capacity();
+        nnp_convolution_inference(nnp_convolution_algorithm_wt8x8,
+                                  nnp_convolution_transform_strategy_precompute,
+                                  size_t(is[1]), size_t(os[1]), input_size, padding, kernel_size,
+                                  stride, NULL, w->data(), NULL, NULL, transformed.data(), &size,
+                                  nnp_activation_identity, NULL, NULL, NULL);
+        Workspace ws;
+        conv_forward(input, output, w, b, pool, pad, pad, 1, false, &ws, &transformed);
+        ms = time_ms([&]() {
+            conv_forward(input, output, w, b, pool, pad, pad, 1, false, &ws, &transformed);
+            return true;
+        });
+        report(net, layer, "conv", "conv_forward/wt8x8-reuse", is, os, threads, ms, flops, bytes);
+    }
+    delete output;
+}
+
+// block shares the sparse rows prune to
+static const float sparse_densities[] = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.8f};
+
+// zeroes each 4x1 block of w with probability 1 - density
+static void prune_blocks(Blob* w, float density) {
+    int rows = w->shape(0);
+    int cols = w->count()/rows;
+    float* data = w->data();
+    for (int g = 0; g < rows; g += 4) {
+        for (int c = 0; c < cols; ++c) {
+            if ((float)rand()/RAND_MAX < density) continue;
+            for (int r = g; r < (std::min)(g + 4, rows); ++r) data[r*cols + c] = 0.0f;
+        }
+    }
+}
+
+// FC (w of 2 axes) or 1x1 convolution without padding; GFLOP/s of the
+// sparse rows count the dense work, so they compare with the dense row
+static void bench_sparse(const char* net, int layer, const Blob* input, const Blob* w,
+                         const Blob* b, threadpool_t pool, int threads) {
+    const bool conv = w->num_axes() == 4;
+    Blob pruned(w->shape());
+    Blob* dense = NULL;
+    Blob* sparse = NULL;
+    Workspace workspace;
+    auto forward = [&](Blob*& output, const SparseWeights* sparse_w) {
+        if (conv) conv_forward(input, output, &pruned, b, pool, 0, 0, 1, false, &workspace,
+                               NULL, NULL, sparse_w);
+        else fully_connected(input, output, &pruned, b, pool, NULL, sparse_w);
+        return true;
+    };
+    memcpy(pruned.data(), w->data(), w->count()*sizeof(float));
+    forward(dense, NULL);
+    const Shape& is = input->shape();
+    const Shape& os = dense->shape();
+    double flops = 2.0*dense->count()*(w->count()/w->shape(0));
+    double bytes = 4.0*(input->count() + w->count() + dense->count());
+    float dense_ms = time_ms([&]() { return forward(dense, NULL); });
+    report(net, layer, conv ? "conv" : "fc", "dense", is, os, threads, dense_ms, flops, bytes);
+
+    float break_even = 0.0f;
+    for (size_t d = 0; d < sizeof(sparse_densities)/sizeof(sparse_densities[0]); ++d) {
+        memcpy(pruned.data(), w->data(), w->count()*sizeof(float));
+        prune_blocks(&pruned, sparse_densities[d]);
+        SparseWeights* sparse_w = SparseWeights::compress(&pruned, 1.0f);
+        forward(dense, NULL);
+        forward(sparse, sparse_w);
+        float max_error = 0.0f;
+        for (int i = 0; i < dense->count(); ++i) {
+            max_error = (std::max)(max_error, fabsf(dense->data()[i] - sparse->data()[i]));
+        }
+        if (max_error > 1e-3f) {
+            fprintf(stderr, "%s layer %d: sparse result off by %g from dense\n", net, layer,
+                    max_error);
+            exit(EXIT_FAILURE);
+        }
+        float ms = time_ms([&]() { return forward(sparse, sparse_w); });
+        char variant[32];
+        snprintf(variant, sizeof(variant), "sparse/%.2f", sparse_w->density());
+        report(net, layer, conv ? "conv" : "fc", variant, is, os, threads, ms, flops, bytes);
+        if (ms <= dense_ms) break_even = (std::max)(break_even, sparse_w->density());
+        delete sparse_w;
+    }
+    printf("# %s %d %s: sparse wins up to density %.2f\n", net, layer,
+           shape_string(w->shape()).c_str(), break_even);
+    delete dense;
+    delete sparse;
+}
+
+static Blob* run_op(const char* net, int layer, const OpSpec& spec, const Blob* input,
+                    const std::vector<Blob*>& param, threadpool_t pool, int threads) {
+    Blob* output = NULL;
+    Blob* scratch = NULL;
+    float ms = -1;
+    double flops = 0, bytes = 0;
+    const char* op = "";
+    switch (spec.kind) {
+        case Conv:
+            bench_conv(net, layer, input, param[spec.param], param[spec.param + 1], spec.pad,
+                       pool, threads);
+            if (param[spec.param]->shape(2) == 1 && param[spec.param]->shape(3) == 1
+                && spec.pad == 0) {
+                bench_sparse(net, layer, input, param[spec.param], param[spec.param + 1],
+                             pool, threads);
+            }
+            conv_forward(input, output, param[spec.param], param[spec.param + 1], pool,
+                         spec.pad, spec.pad, 1, false);
+            return output;
+        case Pool:
+            op = "maxpool";
+            cnn_maxpooling(input, output, spec.size, spec.stride, pool, spec.pad_type);
+            ms = time_ms([&]() {
+                cnn_maxpooling(input, output, spec.size, spec.stride, pool, spec.pad_type);
+                return true;
+            });
+            flops = (double)output->count()*spec.size*spec.size;
+            bytes = 4.0*(input->count() + output->count());
+            break;
+        case Fc:
+            op = "fc";
+            fully_connected(input, output, param[spec.param], param[spec.param + 1], pool);
+            ms = time_ms([&]() {
+                fully_connected(input, output, param[spec.param], param[spec.param + 1], pool);
+                return true;
+            });
+            flops = 2.0*output->count()*param[spec.param]->shape(1);
+            bytes = 4.0*(input->count() + param[spec.param]->count() + output->count());
+            bench_sparse(net, layer, input, param[spec.param], param[spec.param + 1],
+                         pool, threads);
+            break;
+        case Leaky:
+        case Prelu:
+        case Softmax:
+            // in-place ops run on a copy so the chain keeps its values
+            output = new Blob(input->shape());
+            scratch = new Blob(input->shape());
+            memcpy(output->data(), input->data(), input->count()*sizeof(float));
+            ms = time_ms([&]() {
+                memcpy(scratch->data(), input->data(), input->count()*sizeof(float));
+                if (spec.kind == Leaky) leaky(scratch, pool);
+                else if (spec.kind == Prelu) prelu(scratch, param[spec.param]);
+                else softmax(scratch, pool);
+                return true;
+            });
+            if (spec.kind == Leaky) leaky(output, pool);
+            else if (spec.kind == Prelu) prelu(output, param[spec.param]);
+            else softmax(output, pool);
+            op = spec.kind == Leaky ? "leaky" : (spec.kind == Prelu ? "prelu" : "softmax");
+            flops = (spec.kind == Softmax ? 5.0 : 1.0)*input->count();
+            bytes = 4.0*2*input->count();
+            delete scratch;
+            break;
+    }
+    // timings of the in-place ops include restoring their input with memcpy
+    report(net, layer, op, "default", input->shape(), output->shape(), threads, ms, flops, bytes);
+    return output;
+}
+
+static void run_net(const char* net, const OpSpec* ops, int nops, Blob* input,
+                    const std::vector<Blob*>& param, threadpool_t pool, int threads) {
+    std::vector<Blob*> outputs(nops, NULL);
+    const Blob* prev = input;
+    for (int i = 0; i < nops; ++i) {
+        const Blob* src = ops[i].src < 0 ? prev : outputs[ops[i].src];
+        outputs[i] = run_op(net, i, ops[i], src, param, pool, threads);
+        prev = outputs[i];
+    }
+    for (int i = 0; i < nops; ++i) {
+        delete outputs[i];
+    }
+}
+
+static void bench_nms(int count, int threads) {
+    std::vector<bbox> boxes(count);
+    float ms = time_ms([&]() {
+        srand(1);
+        for (int i = 0; i < count; ++i) {
+            int x = rand() % 100, y = rand() % 100, s = 10 + rand() % 30;
+            boxes[i] = bbox(x, y, x + s, y + s, (float)rand()/RAND_MAX);
+        }
+        std::vector<bbox> tmp(boxes);
+        nms(tmp, 0.6f, false);
+        return true;
+    });
+    // nms is O(n^2) IoU tests; bytes are the boxes read once
+    report("detect", -1, "nms", std::to_string(count) + " boxes", Shape(1, count),
+           Shape(1, count), threads, ms, 0.5*count*count*10, (double)count*sizeof(bbox));
+}
+
+static std::vector<int> parse_list(const char* arg) {
+    std::vector<int> values;
+    for (const char* p = arg; *p; ) {
+        values.push_back(atoi(p));
+        const char* comma = strchr(p, ',');
+        if (!comma) break;
+        p = comma + 1;
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+    int width = 112, height = 112;
+    std::vector<int> faces = parse_list("1,2,4,8,16");
+    std::vector<int> threads = parse_list("1,2,4");
+    std::string json_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--input" && has_value) sscanf(argv[++i], "%dx%d", &width, &height);
+        else if (arg == "--faces" && has_value) faces = parse_list(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = parse_list(argv[++i]);
+        else if (arg == "--iters" && has_value) iters = atoi(argv[++i]);
+        else if (arg == "--json" && has_value) json_path = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--input WxH] [--faces 1,2,4] [--threads 1,2,4]"
+                            " [--iters N] [--json <file>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iters <= 0) iters = 1;
+    if (!json_path.empty()) {
+        json = fopen(json_path.c_str(), "w");
+        if (!json) {
+            fprintf(stderr, "Open file fail: %s\n", json_path.c_str());
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\"results\":[\n");
+    }
+
+    // only the shapes matter; random weights keep denormals out of the timings
+    Model model;
+    for (size_t i = 0; i < model.detect_param().size(); ++i) fill_random(model.detect_param()[i]);
+    for (size_t i = 0; i < model.landmark_param().size(); ++i) fill_random(model.landmark_param()[i]);
+
+    printf("%-8s %3s %-8s %-22s %-14s %-14s %3s %10s %8s %8s\n", "net", "#", "op", "variant",
+           "input", "output", "thr", "ms", "GFLOP/s", "GB/s");
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threadpool_t pool = threads[t] > 1 ? create_threadpool(threads[t], PoolOptions()) : NULL;
+        Blob detect_input(1, 3, height, width);
+        fill_random(&detect_input);
+        run_net("detect", detect_ops, sizeof(detect_ops)/sizeof(detect_ops[0]),
+                &detect_input, model.detect_param(), pool, threads[t]);
+        for (size_t f = 0; f < faces.size(); ++f) {
+            Blob landmark_input(faces[f], 3, 48, 48);
+            fill_random(&landmark_input);
+            run_net("landmark", landmark_ops, sizeof(landmark_ops)/sizeof(landmark_ops[0]),
+                    &landmark_input, model.landmark_param(), pool, threads[t]);
+        }
+        if (t == 0) {
+            bench_nms(5*(height/16)*(width/16), 1);
+        }
+        if (pool) threadpool_destroy(pool);
+    }
+
+    if (json) {
+        fprintf(json, "\n]}\n");
+        fclose(json);
+    }
+    return 0;
+}
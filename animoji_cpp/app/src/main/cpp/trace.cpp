@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.hpp"
+
+using namespace std::chrono;
+namespace  galaxy {
+    // kernel thread id, so events line up with systrace / perf
+    static int current_tid() {
+        static thread_local int tid = static_cast<int>(syscall(SYS_gettid));
+        return tid;
+    }
+
+    Tracer::Tracer(size_t capacity)
+        :epoch_(clock::now()), events_(capacity), next_(0) {
+    }
+
+    void Tracer::record(const char* name, const char* category,
+                        clock::time_point begin, clock::time_point end) {
+        size_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= events_.size()) return;
+        Event& event = events_[index];
+        event.name = name;
+        event.category = category;
+        event.begin = duration_cast<microseconds>(begin - epoch_).count();
+        event.duration = duration_cast<microseconds>(end - begin).count();
+        event.tid = current_tid();
+    }
+
+    bool Tracer::write(const std::string& path) const {
+        FILE* fp = fopen(path.c_str(), "w");
+        if (!fp) {
+            fprintf(stderr, "Open file fail: %s\n", path.c_str());
+            return false;
+        }
+        size_t count = next_.load();
+        if (count > events_.size()) count = events_.size();
+        int pid = static_cast<int>(getpid());
+        fprintf(fp, "{\"traceEvents\":[\n");
+        for (size_t i = 0; i < count; ++i) {
+            const Event& e = events_[i];
+            fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,"
+                        "\"dur\":%lld,\"pid\":%d,\"tid\":%d}%s\n",
+                    e.name, e.category, e.begin, e.duration, pid, e.tid,
+                    i + 1 < count ? "," : "");
+        }
+        fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+        return fclose(fp) == 0;
+    }
+
+    void Tracer::clear() {
+        next_.store(0);
+    }
+
+    size_t Tracer::dropped() const {
+        size_t count = next_.load();
+        return count > events_.size() ? count - events_.size() : 0;
+    }
+} //namespace  galaxy
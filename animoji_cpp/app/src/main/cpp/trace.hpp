@@ -0,0 +1,62 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace  galaxy {
+    // Collects complete ("X") events of the inference timeline and writes
+    // them as Chrome trace-event JSON (chrome://tracing, Perfetto). Events go
+    // into a buffer sized up front with one atomic increment each, so any
+    // number of threads may record at once; events past capacity are dropped
+    // and counted. One tracer can be shared by several InferenceContexts.
+    class Tracer {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        explicit Tracer(size_t capacity = 1 << 16);
+        // name and category must outlive the tracer, e.g. string literals
+        void record(const char* name, const char* category,
+                    clock::time_point begin, clock::time_point end);
+        // Call while nothing is recording.
+        bool write(const std::string& path) const;
+        void clear();
+        size_t dropped() const;
+
+    private:
+        struct Event {
+            const char* name;
+            const char* category;
+            long long begin;    // us since the tracer was created
+            long long duration;
+            int tid;
+        };
+
+        clock::time_point epoch_;
+        std::vector<Event> events_;
+        std::atomic<size_t> next_;
+    };
+
+    // Records the enclosing block as one event; free when tracer is NULL.
+    class TraceScope {
+    public:
+        TraceScope(Tracer* tracer, const char* name, const char* category)
+            :tracer_(tracer), name_(name), category_(category) {
+            if (tracer_) begin_ = Tracer::clock::now();
+        }
+        ~TraceScope() {
+            if (tracer_) tracer_->record(name_, category_, begin_, Tracer::clock::now());
+        }
+
+    private:
+        Tracer* tracer_;
+        const char* name_;
+        const char* category_;
+        Tracer::clock::time_point begin_;
+        TraceScope(const TraceScope&);
+        TraceScope& operator=(const TraceScope&);
+    };
+} //namespace  galaxy
+#endif //TRACE_HPP_